@@ -0,0 +1,230 @@
+// See LICENSE for license details.
+
+// Measures the throughput of FIONA instructions without a workload ELF.
+// A block of identical custom0 instructions is placed in a bare memory
+// image and executed by a single hart, once for each funct, vlen and mask
+// density, and once per photonic backend. Results are printed as CSV:
+//   backend,funct,vlen,mask_density,insns,ns_per_insn
+
+#include "config.h"
+#include "fesvr/option_parser.h"
+#include "processor.h"
+#include "simif.h"
+#include "mmu.h"
+#include "devices.h"
+#include "platform.h"
+#include "rocc.h"
+#include "fiona_opcodes.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BLOCK_INSNS 255         // custom0 instructions per loop body
+#define DATA_OFFSET 0x10000     // vector/matrix operands, from DRAM_BASE
+#define MEM_SIZE    0x20000
+
+// Just enough of a simulator for one hart running out of a flat memory
+class bench_sim_t : public simif_t
+{
+public:
+  bench_sim_t(const cfg_t* cfg) : cfg(cfg), mem(MEM_SIZE) { debug_mmu = NULL; }
+
+  char* addr_to_mem(reg_t paddr) {
+    if (paddr >= DRAM_BASE && paddr - DRAM_BASE < MEM_SIZE)
+      return mem.contents(paddr - DRAM_BASE);
+    return NULL;
+  }
+  bool mmio_load(reg_t paddr, size_t len, uint8_t* bytes) { return false; }
+  bool mmio_store(reg_t paddr, size_t len, const uint8_t* bytes) { return false; }
+  void proc_reset(unsigned id) {}
+  const cfg_t &get_cfg() const { return *cfg; }
+  const std::map<size_t, processor_t*>& get_harts() const { return harts; }
+  const char* get_symbol(uint64_t paddr) { return NULL; }
+
+  void write(reg_t paddr, const void* bytes, size_t len) {
+    mem.store(paddr - DRAM_BASE, len, (const uint8_t*)bytes);
+  }
+
+  std::map<size_t, processor_t*> harts;
+
+private:
+  const cfg_t* cfg;
+  mem_t mem;
+};
+
+struct bench_case_t
+{
+  const char* name;
+  unsigned funct;
+  unsigned rd;      // config register for FUNCT_CONFIG
+  unsigned rs2;     // function code for ACTIVATION/MINMAX
+};
+
+static const bench_case_t cases[] = {
+  {"add_v",      FUNCT_ADD_V,      1, 3},
+  {"sub_v",      FUNCT_SUB_V,      1, 3},
+  {"add_vs",     FUNCT_ADD_VS,     1, 3},
+  {"sub_vs",     FUNCT_SUB_VS,     1, 3},
+  {"mul_vs",     FUNCT_MUL_VS,     1, 3},
+  {"div_vs",     FUNCT_DIV_VS,     1, 3},
+  {"relu",       FUNCT_ACTIVATION, 1, ACT_BITS_24_20_RELU},
+  {"vld",        FUNCT_VLD,        1, 3},
+  {"vst",        FUNCT_VST,        1, 3},
+  {"vshfl",      FUNCT_VSHFL,      1, 3},
+  {"max",        FUNCT_MINMAX,     1, 0},
+  {"cfg_vmatrix", FUNCT_CONFIG,    CFG_BITS_11_7_VMATRIX, 3},
+  {"dotp",       FUNCT_DOTP,       1, 3},
+  {"mvm",        FUNCT_MVM,        1, 3},
+};
+
+static const unsigned vlens[] = {8, 16, 32};
+static const double densities[] = {0.0, 0.5, 1.0};
+
+// All operands come from x2 (scalar or address) and vregs 2/3
+static uint32_t encode_custom0(unsigned funct, unsigned rd, unsigned rs1, unsigned rs2)
+{
+  return (funct << 25) | (rs2 << 20) | (rs1 << 15) | (1 << 13) | (1 << 12) | (rd << 7) | ROCC_OPCODE0;
+}
+
+static uint32_t encode_jal_x0(int32_t offset)
+{
+  uint32_t imm = offset;
+  return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) |
+         (((imm >> 11) & 1) << 20) | (((imm >> 12) & 0xff) << 12) | 0x6f;
+}
+
+static void fiona_setup(rocc_t* fiona, unsigned funct, unsigned rd, reg_t xs1, reg_t xs2)
+{
+  rocc_insn_t insn = {};
+  insn.opcode = ROCC_OPCODE0;
+  insn.funct = funct;
+  insn.rd = rd;
+  fiona->custom0(insn, xs1, xs2);
+}
+
+static void help(int exit_code = 1)
+{
+  fprintf(stderr, "usage: fiona-bench [options]\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --backend=<name>      python, native or all [default all]\n");
+  fprintf(stderr, "  --funct=<name>        Only run the named benchmark [default all]\n");
+  fprintf(stderr, "  --insns=<n>           Instructions executed per measurement [default 25500]\n");
+  fprintf(stderr, "  --out=<file>          Write the CSV results to file [default stdout]\n");
+  fprintf(stderr, "  -h, --help            Print this help message\n");
+  exit(exit_code);
+}
+
+static void suggest_help()
+{
+  fprintf(stderr, "Try 'fiona-bench --help' for more information.\n");
+  exit(1);
+}
+
+static void run_backend(const char* backend, const char* only, size_t insns, FILE* out)
+{
+  // The extension picks its model when it is constructed
+  if (strcmp(backend, "native") == 0)
+    setenv("FIONA_PHOTONIC_MODEL", "native", 1);
+  else if (!getenv("FIONA_PHOTONIC_MODEL") || strcmp(getenv("FIONA_PHOTONIC_MODEL"), "native") == 0)
+    setenv("FIONA_PHOTONIC_MODEL", "ideal_numerical", 1);
+
+  cfg_t cfg(std::make_pair((reg_t)0, (reg_t)0), nullptr, DEFAULT_ISA, DEFAULT_PRIV,
+            DEFAULT_VARCH, false, endianness_little, 16,
+            std::vector<mem_cfg_t>(1, mem_cfg_t(DRAM_BASE, MEM_SIZE)),
+            std::vector<size_t>(1, 0), false, 4);
+  isa_parser_t isa(DEFAULT_ISA, DEFAULT_PRIV);
+  bench_sim_t sim(&cfg);
+  processor_t* p = new processor_t(&isa, &cfg, &sim, 0, false, stderr, std::cerr);
+  sim.harts[0] = p;
+  rocc_t* fiona = static_cast<rocc_t*>(find_extension("fiona")());
+  p->register_extension(fiona);
+
+  int16_t data[32 * 32];
+  for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); i++)
+    data[i] = i % 32;
+  reg_t data_addr = DRAM_BASE + DATA_OFFSET;
+  sim.write(data_addr, data, sizeof(data));
+
+  size_t iters = (insns + BLOCK_INSNS - 1) / BLOCK_INSNS;
+  for (auto& c : cases) {
+    if (only && strcmp(only, c.name) != 0)
+      continue;
+
+    std::vector<uint32_t> code(BLOCK_INSNS, encode_custom0(c.funct, c.rd, 2, c.rs2));
+    code.push_back(encode_jal_x0(-BLOCK_INSNS * 4));
+    sim.write(DRAM_BASE, code.data(), code.size() * sizeof(uint32_t));
+    p->get_mmu()->flush_icache();
+
+    for (unsigned vlen : vlens) {
+      for (double density : densities) {
+        unsigned bits = density * 32 + 0.5;
+        reg_t mask = bits >= 32 ? 0xffffffff : (1UL << bits) - 1;
+
+        fiona_setup(fiona, FUNCT_CONFIG, CFG_BITS_11_7_VLEN, vlen, 0);
+        for (unsigned v = 0; v < 4; v++) {
+          fiona_setup(fiona, FUNCT_VLD, v, data_addr, 0);
+          fiona_setup(fiona, FUNCT_CONFIG, CFG_BITS_11_7_VMASK, mask, v);
+        }
+        fiona_setup(fiona, FUNCT_CONFIG, CFG_BITS_11_7_VMATRIX, data_addr, 0);
+
+        p->get_state()->pc = DRAM_BASE;
+        p->get_state()->XPR.write(2, data_addr);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iters; i++)
+          p->step(BLOCK_INSNS + 1);
+        auto end = std::chrono::steady_clock::now();
+
+        // the loop-closing jal is charged to the FIONA instructions
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        fprintf(out, "%s,%s,%u,%.2f,%zu,%.1f\n", backend, c.name, vlen,
+                bits / 32.0, iters * BLOCK_INSNS, ns / (iters * BLOCK_INSNS));
+        fflush(out);
+      }
+    }
+  }
+
+  delete p;
+  delete fiona;
+}
+
+int main(int argc, char** argv)
+{
+  const char* backend = "all";
+  const char* only = NULL;
+  const char* out_file = NULL;
+  size_t insns = 100 * BLOCK_INSNS;
+
+  option_parser_t parser;
+  parser.help(&suggest_help);
+  parser.option('h', "help", 0, [&](const char UNUSED *s){help(0);});
+  parser.option(0, "backend", 1, [&](const char* s){backend = s;});
+  parser.option(0, "funct", 1, [&](const char* s){only = s;});
+  parser.option(0, "insns", 1, [&](const char* s){insns = strtoull(s, 0, 0);});
+  parser.option(0, "out", 1, [&](const char* s){out_file = s;});
+  parser.parse(argv);
+
+  if (strcmp(backend, "all") != 0 && strcmp(backend, "python") != 0 && strcmp(backend, "native") != 0) {
+    fprintf(stderr, "unknown backend '%s'\n", backend);
+    suggest_help();
+  }
+
+  FILE* out = stdout;
+  if (out_file && !(out = fopen(out_file, "w"))) {
+    fprintf(stderr, "could not open %s\n", out_file);
+    exit(1);
+  }
+
+  fprintf(out, "backend,funct,vlen,mask_density,insns,ns_per_insn\n");
+  if (strcmp(backend, "native") != 0)
+    run_backend("python", only, insns, out);
+  if (strcmp(backend, "python") != 0)
+    run_backend("native", only, insns, out);
+
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
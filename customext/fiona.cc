@@ -2,15 +2,20 @@
 #include "processor.h"
 #include "rocc.h"
 #include "mmu.h"
+#include "checkpoint.h"
 #include "debug.h"
 #include <cstdlib>
 #include <math.h>
 #include "fiona_opcodes.h"
+#include "fiona_check.h"
 #include <cstdint>
 #include <cstring>
 #include <stdio.h>
 #include <map>
-// Python bridge
+#include <algorithm>
+// Python bridge; pyconfig.h defines its own HAVE_DLOPEN
+#undef HAVE_DLOPEN
+#include <Python.h>
 #include "engine.h"
 
 #define FIONAVLENMax 32
@@ -37,7 +42,40 @@ map<unsigned, string> instr_name = {
     {FUNCT_MVM, "mvm"},
     {FUNCT_DUMP, "dump"},
 };
-map<string, int> instr_count;
+// Shared by all harts; reports at exit
+static fiona_checker_t checker;
+
+// The photonic model runs in the embedded Python interpreter. Harts on
+// their own host threads (spike --parallel) take turns through the GIL,
+// which the thread that set up the bridge gives up afterwards.
+static PyThreadState* python_main_state = NULL;
+
+static void photonic_init()
+{
+    if (python_main_state) {
+        PyGILState_STATE gil = PyGILState_Ensure();
+        init_python_env();
+        PyGILState_Release(gil);
+        return;
+    }
+    init_python_env();
+    if (Py_IsInitialized() && PyGILState_Check()) {
+        python_main_state = PyEval_SaveThread();
+        atexit([]() { PyEval_RestoreThread(python_main_state); });
+    }
+}
+
+template<typename... Args>
+static void photonic_call(Args... args)
+{
+    if (!python_main_state) {
+        array_handle(args...);
+        return;
+    }
+    PyGILState_STATE gil = PyGILState_Ensure();
+    array_handle(args...);
+    PyGILState_Release(gil);
+}
 
 extern int16_t fiona_nn_activation_s16( int16_t type, int16_t input, uint16_t left_shift);
 
@@ -58,6 +96,40 @@ typedef int16_t vreg_t;
     }\
 }
 
+// Disassembly operands
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return vr_name[insn.rd()]; }
+} fiona_vd;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return vr_name[insn.rs1()]; }
+} fiona_vs1;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return vr_name[insn.rs2()]; }
+} fiona_vs2;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return xpr_name[insn.rd()]; }
+} fiona_xd;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return xpr_name[insn.rs1()]; }
+} fiona_xs1;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return xpr_name[insn.rs2()]; }
+} fiona_xs2;
+
+struct : public arg_t {
+    std::string to_string(insn_t insn) const { return std::string("(") + xpr_name[insn.rs1()] + ')'; }
+} fiona_addr;
+
+#define FIONA_MATCH(funct) (((uint32_t)(funct) << 25) | ROCC_OPCODE0)
+#define FIONA_MASK          0xfe00007f
+#define FIONA_MASK_RD       (FIONA_MASK | 0x00000f80)
+#define FIONA_MASK_RS2      (FIONA_MASK | 0x01f00000)
+
 class fiona_rocc_t : public rocc_t
 {
     public:
@@ -73,7 +145,8 @@ class fiona_rocc_t : public rocc_t
             // Log("rd = %d, rs1 = %d, rs2 = %d", rd_num, rs1_num, rs2_num);
             // Log("xs1 = %x, xs2 = %x", xs1, xs2);
 
-            instr_count[instr_name[insn.funct]] += 1;
+            auto name = instr_name.find(insn.funct);
+            instr_count[name != instr_name.end() ? name->second : ""] += 1;
             uint32_t mask_1 = vmask[rs1_num];
             uint32_t mask_2 = vmask[rs2_num];
             uint16_t masked_op1[32];
@@ -114,10 +187,19 @@ class fiona_rocc_t : public rocc_t
                                                vec_0[i] = masked_op1[i];
                                                vec_1[i] = masked_op2[i];
                                            }
-                                           vreg_t* res;
-                                           array_handle("ideal_numerical", "dotp", &res, 1, 1, vec_0, FIONAVLENMax, 1, vec_1, FIONAVLENMax, 1);
-                                           // Convert the data back to 16-bits
-                                           result = (int16_t)*res;
+                                           if (native_model) {
+                                               fiona_golden_dotp(vec_0, vec_1, FIONAVLENMax, &result);
+                                           } else {
+                                               vreg_t* res;
+                                               photonic_call(photonic_model, "dotp", &res, 1, 1, vec_0, FIONAVLENMax, 1, vec_1, FIONAVLENMax, 1);
+                                               // Convert the data back to 16-bits
+                                               result = (int16_t)*res;
+                                           }
+                                           if (checker.enabled() && checker.sample()) {
+                                               vreg_t golden;
+                                               fiona_golden_dotp(vec_0, vec_1, FIONAVLENMax, &golden);
+                                               checker.compare("dotp", p->get_state()->pc, &result, &golden, 1);
+                                           }
                                            break;
                                        }
 
@@ -134,41 +216,30 @@ class fiona_rocc_t : public rocc_t
                                                    mat[i * FIONAVLENMax + j] = matrix[i][j];
                                                }
                                            }
-                                           vreg_t *res;
-                                           array_handle("ideal_numerical", "mvm", &res, FIONAVLENMax, 1, vec, FIONAVLENMax, 1, mat, FIONAVLENMax, FIONAVLENMax);
-                                           // array_handle("ideal_numerical", "mvm", &res, FIONAVLENMax, 1, mat, FIONAVLENMax, FIONAVLENMax, vec, FIONAVLENMax, 1);
-                                           // Convert the data back to 16-bits
-                                           for(uint32_t i = 0; i < vlen; i++) {
-                                               vregs[rd_num][i] = res[i];
+                                           if (native_model) {
+                                               fiona_golden_mvm(mat, FIONAVLENMax, vec, vlen, vregs[rd_num]);
+                                           } else {
+                                               vreg_t *res;
+                                               photonic_call(photonic_model, "mvm", &res, FIONAVLENMax, 1, vec, FIONAVLENMax, 1, mat, FIONAVLENMax, FIONAVLENMax);
+                                               // array_handle("ideal_numerical", "mvm", &res, FIONAVLENMax, 1, mat, FIONAVLENMax, FIONAVLENMax, vec, FIONAVLENMax, 1);
+                                               // Convert the data back to 16-bits
+                                               for(uint32_t i = 0; i < vlen; i++) {
+                                                   vregs[rd_num][i] = res[i];
+                                               }
+                                           }
+                                           if (checker.enabled() && checker.sample()) {
+                                               vreg_t golden[FIONAVLENMax];
+                                               fiona_golden_mvm(mat, FIONAVLENMax, vec, vlen, golden);
+                                               checker.compare("mvm", p->get_state()->pc, vregs[rd_num], golden, vlen);
                                            }
                                            break;
                                        }
                 case FUNCT_VLD: // Load rs1=base, vd=vec
-                                  {
-                                      // Log("Load");
-                                      reg_t ptr = xs1;
-                                      for(uint32_t i = 0; i < vlen && i < 32; i++) {
-                                          int16_t load_val = p->get_mmu()->load<int16_t>(ptr);
-                                          // printf("Load from %p\n", ptr);
-                                          // printf("Value = %x\n", load_val);
-                                          vregs[rd_num][i] = load_val;
-                                          ptr = ptr + stride * sizeof(vreg_t);
-                                      }
-                                      break;
-                                  }
+                                  vector_load(xs1, vregs[rd_num], access_length());
+                                  break;
                 case FUNCT_VST: // Store rs1=base, vs2=vec
-                                  {
-                                      // Log("Store\n");
-                                      reg_t ptr = xs1;
-                                      for(uint32_t i = 0; i < vlen && i < 32; i++) {
-                                          vreg_t store_val = vregs[rs2_num][i];
-                                          // Log("Store to %p", ptr);
-                                          // Log("Value = %x", store_val);
-                                          p->get_mmu()->store<vreg_t>(ptr, store_val);
-                                          ptr = ptr + stride * sizeof(vreg_t);
-                                      }
-                                      break;
-                                  }
+                                  vector_store(xs1, vregs[rs2_num], access_length());
+                                  break;
 
 
                 case FUNCT_DUMP: printf("DUMP"); dump(); break;
@@ -177,9 +248,73 @@ class fiona_rocc_t : public rocc_t
                                   break;
             }
 
+            if (p->get_log_commits_enabled())
+                log_commit(insn.funct, rd_num);
+
             return result; // in all cases, xd <- previous value of acc[rs2]
         }
 
+        std::vector<disasm_insn_t*> get_disasms()
+        {
+            std::vector<disasm_insn_t*> insns;
+            #define DISASM(name, match, mask, ...) \
+                insns.push_back(new disasm_insn_t(name, match, mask, {__VA_ARGS__}))
+            DISASM("fiona.add.v", FIONA_MATCH(FUNCT_ADD_V), FIONA_MASK, &fiona_vd, &fiona_vs1, &fiona_vs2);
+            DISASM("fiona.sub.v", FIONA_MATCH(FUNCT_SUB_V), FIONA_MASK, &fiona_vd, &fiona_vs1, &fiona_vs2);
+            DISASM("fiona.add.vs", FIONA_MATCH(FUNCT_ADD_VS), FIONA_MASK, &fiona_vd, &fiona_xs1, &fiona_vs2);
+            DISASM("fiona.sub.vs", FIONA_MATCH(FUNCT_SUB_VS), FIONA_MASK, &fiona_vd, &fiona_xs1, &fiona_vs2);
+            DISASM("fiona.mul.vs", FIONA_MATCH(FUNCT_MUL_VS), FIONA_MASK, &fiona_vd, &fiona_xs1, &fiona_vs2);
+            DISASM("fiona.div.vs", FIONA_MATCH(FUNCT_DIV_VS), FIONA_MASK, &fiona_vd, &fiona_xs1, &fiona_vs2);
+            DISASM("fiona.relu", FIONA_MATCH(FUNCT_ACTIVATION) | (ACT_BITS_24_20_RELU << 20), FIONA_MASK_RS2, &fiona_vd, &fiona_vs1);
+            DISASM("fiona.tanh", FIONA_MATCH(FUNCT_ACTIVATION) | (ACT_BITS_24_20_TANH << 20), FIONA_MASK_RS2, &fiona_vd, &fiona_vs1);
+            DISASM("fiona.sigm", FIONA_MATCH(FUNCT_ACTIVATION) | (ACT_BITS_24_20_SIGM << 20), FIONA_MASK_RS2, &fiona_vd, &fiona_vs1);
+            DISASM("fiona.vld", FIONA_MATCH(FUNCT_VLD), FIONA_MASK, &fiona_vd, &fiona_addr);
+            DISASM("fiona.vst", FIONA_MATCH(FUNCT_VST), FIONA_MASK, &fiona_vs2, &fiona_addr);
+            DISASM("fiona.vshfl", FIONA_MATCH(FUNCT_VSHFL), FIONA_MASK, &fiona_vd, &fiona_vs1, &fiona_vs2);
+            DISASM("fiona.max", FIONA_MATCH(FUNCT_MINMAX), FIONA_MASK_RS2, &fiona_xd, &fiona_vs1);
+            DISASM("fiona.min", FIONA_MATCH(FUNCT_MINMAX) | (1 << 20), FIONA_MASK_RS2, &fiona_xd, &fiona_vs1);
+            DISASM("fiona.cfg.vlen", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_VLEN << 7), FIONA_MASK_RD, &fiona_xs1);
+            DISASM("fiona.cfg.vmask", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_VMASK << 7), FIONA_MASK_RD, &fiona_xs1, &fiona_xs2);
+            DISASM("fiona.cfg.vmatrix", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_VMATRIX << 7), FIONA_MASK_RD, &fiona_addr);
+            DISASM("fiona.cfg.stride", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_STRIDE << 7), FIONA_MASK_RD, &fiona_xs1);
+            DISASM("fiona.cfg.pitch", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_PITCH << 7), FIONA_MASK_RD, &fiona_xs1);
+            DISASM("fiona.cfg.tile", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_TILE << 7), FIONA_MASK_RD, &fiona_xs1, &fiona_xs2);
+            DISASM("fiona.cfg.index", FIONA_MATCH(FUNCT_CONFIG) | (CFG_BITS_11_7_INDEX << 7), FIONA_MASK_RD, &fiona_xs1, &fiona_xs2);
+            DISASM("fiona.dotp", FIONA_MATCH(FUNCT_DOTP), FIONA_MASK, &fiona_xd, &fiona_vs1, &fiona_vs2);
+            DISASM("fiona.mvm", FIONA_MATCH(FUNCT_MVM), FIONA_MASK, &fiona_vd, &fiona_vs1);
+            DISASM("fiona.dump", FIONA_MATCH(FUNCT_DUMP), FIONA_MASK, );
+            #undef DISASM
+            return insns;
+        }
+
+        // Commit-log records are kept compact: only the vlen elements a
+        // vreg write produced (" fv<n> "), and a 64-bit FNV-1a digest of
+        // the weight matrix after a VMATRIX load (" fm0 ").
+        void log_commit(uint32_t funct, uint32_t rd_num)
+        {
+            auto& log = p->get_state()->log_ext_write;
+            switch (funct) {
+                case FUNCT_ADD_V: case FUNCT_SUB_V: case FUNCT_ADD_VS: case FUNCT_SUB_VS:
+                case FUNCT_MUL_VS: case FUNCT_DIV_VS: case FUNCT_VSHFL: case FUNCT_ACTIVATION:
+                case FUNCT_MVM: case FUNCT_VLD:
+                    {
+                        const uint8_t* bytes = (const uint8_t*)vregs[rd_num];
+                        size_t n = (vlen < 32 ? vlen : 32) * sizeof(vreg_t);
+                        log.emplace_back("fv", rd_num, std::vector<uint8_t>(bytes, bytes + n));
+                        break;
+                    }
+                case FUNCT_CONFIG:
+                    if (rd_num == CFG_BITS_11_7_VMATRIX) {
+                        const uint8_t* bytes = (const uint8_t*)matrix;
+                        uint64_t digest = 0xcbf29ce484222325ULL;
+                        for(size_t i = 0; i < sizeof(matrix); i++)
+                            digest = (digest ^ bytes[i]) * 0x100000001b3ULL;
+                        log.emplace_back("fm", 0, std::vector<uint8_t>((uint8_t*)&digest, (uint8_t*)&digest + sizeof(digest)));
+                    }
+                    break;
+            }
+        }
+
         inline vreg_t fiona_activation(uint32_t function_code, vreg_t x)   // TODO: We need quantitize
         {
             vreg_t result = 0;
@@ -194,40 +329,210 @@ class fiona_rocc_t : public rocc_t
         void fiona_config(uint32_t config_reg, reg_t rs1, reg_t rs2) 
         {
             switch (config_reg) {
-                case 0:    // VLEN
+                case CFG_BITS_11_7_VLEN:
                     if(rs1 > 32) illegal_instruction();
                     vlen = rs1;
                     break;
-                case 1:   // VMASK
+                case CFG_BITS_11_7_VMASK:
                     vmask[rs2] = rs1;
                     break;
-                case 2:   // VMatrix
+                case CFG_BITS_11_7_VMATRIX:
                     {
-                        reg_t ptr = rs1;
-                        for(uint32_t i = 0; i < vlen && i < 32; i++) {
-                            for(uint32_t j = 0; j < vlen && j < 32; j++) {
-                                int16_t load_val = p->get_mmu()->load<int16_t>(ptr);
-                                matrix[i][j] = load_val;
-                                ptr = ptr + stride * sizeof(vreg_t);
+                        uint32_t n = vlen < 32 ? vlen : 32;
+                        reg_t pitch = row_pitch(n);
+                        // Skip the reload if the same region was loaded last
+                        // time and none of its pages have been stored to since
+                        reg_t len = ((n - 1) * pitch + (n - 1) * stride + 1) * sizeof(vreg_t);
+                        std::vector<uint64_t> gens = region_generations(rs1, len);
+                        if (!gens.empty() && gens == weight_gens && rs1 == weight_addr &&
+                            n == weight_n && pitch == weight_pitch && stride == weight_stride)
+                            break;
+                        weight_gens = gens;
+                        weight_addr = rs1;
+                        weight_n = n;
+                        weight_pitch = pitch;
+                        weight_stride = stride;
+                        for(uint32_t i = 0; i < n; i++) {
+                            reg_t row = rs1 + i * pitch * sizeof(vreg_t);
+                            if (stride == 1) {
+                                bulk_load(row, matrix[i], n);
+                            } else {
+                                for(uint32_t j = 0; j < n; j++)
+                                    matrix[i][j] = p->get_mmu()->load<int16_t>(row + j * stride * sizeof(vreg_t));
                             }
                         }
                     }
                     break;
+                case CFG_BITS_11_7_STRIDE:
+                    stride = rs1;
+                    break;
+                case CFG_BITS_11_7_PITCH:  // 0 packs rows back to back
+                    pitch = rs1;
+                    break;
+                case CFG_BITS_11_7_TILE:   // cols = 0 returns to 1-D access
+                    if(rs1 * rs2 > 32) illegal_instruction();
+                    tile_rows = rs2 ? rs1 : 0;
+                    tile_cols = rs1 ? rs2 : 0;
+                    break;
+                case CFG_BITS_11_7_INDEX:
+                    if(rs1 >= 32) illegal_instruction();
+                    index_vreg = rs1;
+                    index_enabled = rs2 != 0;
+                    break;
                 default:
                     printf("UnImp config reg!\n");
                     illegal_instruction();
             }
         }
+
+        // Write generations of the pages under [addr, addr + len), or none
+        // if the region is too sparse to be worth watching
+        std::vector<uint64_t> region_generations(reg_t addr, reg_t len)
+        {
+            std::vector<uint64_t> gens;
+            if (len > MAX_WEIGHT_PAGES * PGSIZE)
+                return gens;
+            for(reg_t page = addr & ~(reg_t)(PGSIZE - 1); page < addr + len; page += PGSIZE)
+                gens.push_back(p->get_mmu()->page_write_generation(page));
+            return gens;
+        }
+
+        // Elements moved by one VLD/VST under the current addressing mode
+        uint32_t access_length()
+        {
+            uint32_t n = vlen < 32 ? vlen : 32;
+            if (tile_cols && !index_enabled && tile_rows * tile_cols < n)
+                n = tile_rows * tile_cols;
+            return n;
+        }
+
+        reg_t row_pitch(uint32_t cols)
+        {
+            return pitch ? pitch : (reg_t)cols * stride;
+        }
+
+        // Byte offset of element i from the base address of a VLD/VST
+        reg_t element_offset(uint32_t i)
+        {
+            if (index_enabled)
+                return (reg_t)(sreg_t)vregs[index_vreg][i] * sizeof(vreg_t);
+            if (tile_cols)
+                return ((i / tile_cols) * row_pitch(tile_cols) + (i % tile_cols) * stride) * sizeof(vreg_t);
+            return (reg_t)i * stride * sizeof(vreg_t);
+        }
+
+        // Unit-stride runs go through the MMU once per page instead of once
+        // per element
+        void bulk_load(reg_t addr, vreg_t* dst, uint32_t n)
+        {
+            target_endian<vreg_t> buf[FIONAVLENMax];
+            p->get_mmu()->load_bytes(addr, n * sizeof(vreg_t), (uint8_t*)buf);
+            for(uint32_t i = 0; i < n; i++)
+                dst[i] = p->get_mmu()->from_target(buf[i]);
+        }
+
+        void bulk_store(reg_t addr, const vreg_t* src, uint32_t n)
+        {
+            target_endian<vreg_t> buf[FIONAVLENMax];
+            for(uint32_t i = 0; i < n; i++)
+                buf[i] = p->get_mmu()->to_target(src[i]);
+            p->get_mmu()->store_bytes(addr, n * sizeof(vreg_t), (const uint8_t*)buf);
+        }
+
+        void vector_load(reg_t base, vreg_t* vd, uint32_t n)
+        {
+            if (!index_enabled && stride == 1) {
+                uint32_t row = tile_cols ? tile_cols : n;
+                for(uint32_t i = 0; i < n; i += row)
+                    bulk_load(base + element_offset(i), vd + i, std::min(row, n - i));
+            } else {
+                for(uint32_t i = 0; i < n; i++)
+                    vd[i] = p->get_mmu()->load<int16_t>(base + element_offset(i));
+            }
+        }
+
+        void vector_store(reg_t base, const vreg_t* vs, uint32_t n)
+        {
+            if (!index_enabled && stride == 1) {
+                uint32_t row = tile_cols ? tile_cols : n;
+                for(uint32_t i = 0; i < n; i += row)
+                    bulk_store(base + element_offset(i), vs + i, std::min(row, n - i));
+            } else {
+                for(uint32_t i = 0; i < n; i++)
+                    p->get_mmu()->store<vreg_t>(base + element_offset(i), vs[i]);
+            }
+        }
         fiona_rocc_t()
         {
             // memset(acc, 0, sizeof(acc));
+            const char* model = getenv("FIONA_PHOTONIC_MODEL");
+            photonic_model = model ? model : "ideal_numerical";
+            // "native" runs the ideal model in C++ without the Python bridge
+            native_model = strcmp(photonic_model, "native") == 0;
             vlen = 32;
             stride = 1;
-            init_python_env();
+            pitch = 0;
+            tile_rows = tile_cols = 0;
+            index_vreg = 0;
+            index_enabled = false;
+            weight_addr = 0;
+            weight_n = 0;
+            weight_pitch = 0;
+            weight_stride = 0;
+            if (!native_model)
+                photonic_init();
             for(int i = 0; i < 32; i++) {
               vmask[i] = 0xffffffff;
             }
         }
+        void save(checkpoint_out_t& out)
+        {
+            out.put(vregs);
+            out.put(matrix);
+            out.put(vmask);
+            out.put(vlen);
+            out.put(stride);
+            out.put(pitch);
+            out.put(tile_rows);
+            out.put(tile_cols);
+            out.put(index_vreg);
+            out.put(index_enabled);
+            out.put(weight_addr);
+            out.put(weight_n);
+            out.put(weight_pitch);
+            out.put(weight_stride);
+            out.put<uint64_t>(instr_count.size());
+            for(auto& x: instr_count) {
+                out.put(x.first);
+                out.put(x.second);
+            }
+        }
+        void restore(checkpoint_in_t& in)
+        {
+            in.get(vregs);
+            in.get(matrix);
+            in.get(vmask);
+            in.get(vlen);
+            in.get(stride);
+            in.get(pitch);
+            in.get(tile_rows);
+            in.get(tile_cols);
+            in.get(index_vreg);
+            in.get(index_enabled);
+            in.get(weight_addr);
+            in.get(weight_n);
+            in.get(weight_pitch);
+            in.get(weight_stride);
+            // write generations do not survive a restore, so the weights
+            // are reloaded by the next load of the matrix
+            weight_gens.clear();
+            instr_count.clear();
+            for(uint64_t n = in.get<uint64_t>(); n > 0; n--) {
+                std::string name;
+                in.get(name);
+                in.get(instr_count[name]);
+            }
+        }
         void show_reg_state() 
         {
             for(int i = 0; i < 32; i++) {
@@ -247,11 +552,27 @@ class fiona_rocc_t : public rocc_t
         }
 
     private:
+        const char* photonic_model;
+        bool native_model;
+        map<string, int> instr_count;
         vreg_t vregs[32][32];
         vreg_t matrix[32][32];
         uint32_t vmask[32];
         uint32_t vlen;
         uint32_t stride;
+        uint32_t pitch;
+        uint32_t tile_rows;
+        uint32_t tile_cols;
+        uint32_t index_vreg;
+        bool index_enabled;
+
+        // Source of the weights currently in matrix, for lazy reloads
+        static const reg_t MAX_WEIGHT_PAGES = 16;
+        std::vector<uint64_t> weight_gens;
+        reg_t weight_addr;
+        uint32_t weight_n;
+        reg_t weight_pitch;
+        uint32_t weight_stride;
 };
 
 REGISTER_EXTENSION(fiona, []() { return new fiona_rocc_t; })
@@ -0,0 +1,103 @@
+#include "fiona_check.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+void fiona_golden_dotp(const int16_t* vec_0, const int16_t* vec_1, uint32_t n, int16_t* res)
+{
+    int64_t acc = 0;
+    for(uint32_t i = 0; i < n; i++)
+        acc += (int32_t)vec_0[i] * vec_1[i];
+    *res = (int16_t)acc;
+}
+
+void fiona_golden_mvm(const int16_t* mat, uint32_t ld, const int16_t* vec, uint32_t n, int16_t* res)
+{
+    for(uint32_t i = 0; i < n; i++) {
+        int64_t acc = 0;
+        for(uint32_t j = 0; j < n; j++)
+            acc += (int32_t)mat[i * ld + j] * vec[j];
+        res[i] = (int16_t)acc;
+    }
+}
+
+fiona_checker_t::fiona_checker_t()
+    : every(0), rate(0), tolerance(-1), rng(0x4649304e41ULL),
+      calls(0), checked(0), mismatches(0), max_abs_error(0),
+      diverged(false), first_divergent_pc(0), first_divergent_funct(nullptr)
+{
+    memset(histogram, 0, sizeof(histogram));
+
+    if (const char* s = getenv("FIONA_CHECK_EVERY"))
+        every = strtoull(s, nullptr, 0);
+    if (const char* s = getenv("FIONA_CHECK_RATE"))
+        rate = atof(s);
+    if (const char* s = getenv("FIONA_CHECK_TOLERANCE"))
+        tolerance = atol(s);
+}
+
+bool fiona_checker_t::sample()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    calls++;
+    if (every != 0 && calls % every == 0)
+        return true;
+    if (rate > 0)
+        return std::uniform_real_distribution<double>(0, 1)(rng) < rate;
+    return false;
+}
+
+void fiona_checker_t::compare(const char* funct, reg_t pc, const int16_t* model, const int16_t* golden, uint32_t n)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    checked++;
+    long worst = 0;
+    for(uint32_t i = 0; i < n; i++) {
+        long err = labs((long)model[i] - golden[i]);
+        int bucket = 0;
+        while (bucket < HIST_BUCKETS - 1 && (1L << bucket) <= err)
+            bucket++;
+        histogram[bucket]++;
+        if (err > worst)
+            worst = err;
+    }
+
+    if (worst == 0)
+        return;
+
+    mismatches++;
+    if (worst > max_abs_error)
+        max_abs_error = worst;
+    if (!diverged) {
+        diverged = true;
+        first_divergent_pc = pc;
+        first_divergent_funct = funct;
+    }
+
+    if (tolerance >= 0 && worst > tolerance) {
+        fprintf(stderr, "fiona: %s at pc 0x%" PRIx64 " differs from the golden model by %ld (tolerance %ld)\n",
+                funct, pc, worst, tolerance);
+        report(stderr);
+        exit(1);
+    }
+}
+
+void fiona_checker_t::report(FILE* out) const
+{
+    if (!enabled())
+        return;
+
+    fprintf(out, "fiona golden check: %" PRIu64 " of %" PRIu64 " photonic calls checked, %" PRIu64 " mismatched\n",
+            checked, calls, mismatches);
+    fprintf(out, "  max abs error: %ld\n", max_abs_error);
+    if (diverged)
+        fprintf(out, "  first divergence: %s at pc 0x%" PRIx64 "\n", first_divergent_funct, first_divergent_pc);
+    fprintf(out, "  abs error histogram (elements):\n");
+    for(int i = 0; i < HIST_BUCKETS; i++) {
+        if (histogram[i] == 0)
+            continue;
+        long lo = i == 0 ? 0 : 1L << (i - 1);
+        long hi = i == HIST_BUCKETS - 1 ? 65535 : (1L << i) - 1;
+        fprintf(out, "    [%ld, %ld]: %" PRIu64 "\n", lo, hi, histogram[i]);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __FIONA_CHECK_H__
+#define __FIONA_CHECK_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include "decode.h"
+
+// Native ideal model of the photonic units, used as the golden reference
+void fiona_golden_dotp(const int16_t* vec_0, const int16_t* vec_1, uint32_t n, int16_t* res);
+void fiona_golden_mvm(const int16_t* mat, uint32_t ld, const int16_t* vec, uint32_t n, int16_t* res);
+
+// Differential checker for DOTP/MVM results of the photonic model.
+// Sampling is configured from the environment:
+//   FIONA_CHECK_EVERY=<n>      check every n-th photonic call
+//   FIONA_CHECK_RATE=<f>       check a random fraction f of photonic calls
+//   FIONA_CHECK_TOLERANCE=<e>  stop the run once an error exceeds e
+class fiona_checker_t
+{
+    public:
+        fiona_checker_t();
+        ~fiona_checker_t() { report(stderr); }
+
+        bool enabled() const { return every != 0 || rate > 0; }
+        // Whether the current photonic call should be checked
+        bool sample();
+        void compare(const char* funct, reg_t pc, const int16_t* model, const int16_t* golden, uint32_t n);
+        void report(FILE* out) const;
+
+    private:
+        static const int HIST_BUCKETS = 17;   // 0, 1, 2-3, ..., 2^15-65535
+
+        std::mutex lock;    // harts may run on their own host threads
+        uint64_t every;
+        double rate;
+        long tolerance;     // < 0 disables the hard-fail threshold
+        std::mt19937_64 rng;
+
+        uint64_t calls;
+        uint64_t checked;
+        uint64_t mismatches;
+        long max_abs_error;
+        uint64_t histogram[HIST_BUCKETS];
+        bool diverged;
+        reg_t first_divergent_pc;
+        const char* first_divergent_funct;
+};
+
+#endif
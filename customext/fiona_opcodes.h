@@ -20,6 +20,13 @@
 #define FUNCT_MINMAX	11
 
 #define FUNCT_CONFIG	12
+#define CFG_BITS_11_7_VLEN	0
+#define CFG_BITS_11_7_VMASK	1
+#define CFG_BITS_11_7_VMATRIX	2
+#define CFG_BITS_11_7_STRIDE	3	// element stride of VLD/VST/VMatrix
+#define CFG_BITS_11_7_PITCH	4	// row pitch of 2-D tiles and VMatrix
+#define CFG_BITS_11_7_TILE	5	// 2-D tile shape: rs1 = rows, rs2 = cols
+#define CFG_BITS_11_7_INDEX	6	// gather/scatter: rs1 = index vreg, rs2 = enable
 
 #define FUNCT_DOTP	13
 #define FUNCT_MVM	14
@@ -193,6 +193,7 @@ void htif_t::load_program()
     if ( it == addr2symbol.end())
       addr2symbol[i.second] = i.first;
   }
+  symbol2addr = symbols;
 
   return;
 }
@@ -207,6 +208,27 @@ const char* htif_t::get_symbol(uint64_t addr)
   return it->second.c_str();
 }
 
+const char* htif_t::get_enclosing_symbol(uint64_t addr, uint64_t* base)
+{
+  auto it = addr2symbol.upper_bound(addr);
+
+  if (it == addr2symbol.begin() || (--it)->second.empty())
+      return nullptr;
+
+  if (base)
+      *base = it->first;
+  return it->second.c_str();
+}
+
+bool htif_t::get_symbol_address(const std::string& name, uint64_t* addr)
+{
+  auto it = symbol2addr.find(name);
+  if (it == symbol2addr.end())
+    return false;
+  *addr = it->second;
+  return true;
+}
+
 void htif_t::stop()
 {
   if (!sig_file.empty() && sig_len) // print final torture test signature
@@ -248,7 +270,6 @@ int htif_t::run()
   start();
 
   auto enq_func = [](std::queue<reg_t>* q, uint64_t x) { q->push(x); };
-  std::queue<reg_t> fromhost_queue;
   std::function<void(reg_t)> fromhost_callback =
     std::bind(enq_func, &fromhost_queue, std::placeholders::_1);
 
@@ -9,6 +9,7 @@
 #include "byteorder.h"
 #include <string.h>
 #include <map>
+#include <queue>
 #include <vector>
 #include <assert.h>
 
@@ -73,6 +74,14 @@ class htif_t : public chunked_memif_t
 
   // Given an address, return symbol from addr2symbol map
   const char* get_symbol(uint64_t addr);
+  // Given an address, return the nearest symbol at or below it, and
+  // where that symbol starts
+  const char* get_enclosing_symbol(uint64_t addr, uint64_t* base = nullptr);
+  // Given a symbol name, find its address
+  bool get_symbol_address(const std::string& name, uint64_t* addr);
+
+  // responses from host devices waiting for fromhost to be free
+  std::queue<reg_t>& get_fromhost_queue() { return fromhost_queue; }
 
  private:
   void parse_arguments(int argc, char ** argv);
@@ -92,6 +101,7 @@ class htif_t : public chunked_memif_t
   addr_t fromhost_addr;
   int exitcode;
   bool stopped;
+  std::queue<reg_t> fromhost_queue;
 
   device_list_t device_list;
   syscall_t syscall_proxy;
@@ -101,6 +111,7 @@ class htif_t : public chunked_memif_t
 
   std::vector<std::string> symbol_elfs;
   std::map<uint64_t, std::string> addr2symbol;
+  std::map<std::string, uint64_t> symbol2addr;
 
   friend class memif_t;
   friend class syscall_t;
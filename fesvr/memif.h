@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdexcept>
+#include <vector>
+#include <sys/uio.h>
 #include "byteorder.h"
 #include "../riscv/cfg.h"
 
@@ -23,6 +25,12 @@ public:
   virtual size_t chunk_align() = 0;
   virtual size_t chunk_max_size() = 0;
 
+  // Append the host memory that holds [taddr, taddr + len) to iov, as few
+  // pieces as possible, for I/O in place; write says whether the target
+  // memory will be written. Returns false if any of it is not plain memory.
+  virtual bool host_iovecs(addr_t taddr, size_t len, bool write,
+                           std::vector<struct iovec>& iov) { return false; }
+
   virtual endianness_t get_target_endianness() const {
     return endianness_little;
   }
@@ -40,6 +48,12 @@ public:
   virtual void read(addr_t addr, size_t len, void* bytes);
   virtual void write(addr_t addr, size_t len, const void* bytes);
 
+  // see chunked_memif_t::host_iovecs
+  virtual bool host_iovecs(addr_t addr, size_t len, bool write,
+                           std::vector<struct iovec>& iov) {
+    return cmemif->host_iovecs(addr, len, write, iov);
+  }
+
   // read and write 8-bit words
   virtual target_endian<uint8_t> read_uint8(addr_t addr);
   virtual target_endian<int8_t> read_int8(addr_t addr);
@@ -7,11 +7,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <limits.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <termios.h>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 using namespace std::placeholders;
@@ -229,8 +231,38 @@ static reg_t sysret_errno(sreg_t ret)
   return ret == -1 ? -errno : ret;
 }
 
+// Do I/O on guest memory in place, in as many calls as IOV_MAX requires,
+// stopping at the first short one
+template <typename F>
+static ssize_t iov_transfer(const std::vector<struct iovec>& iov, F io)
+{
+  ssize_t done = 0;
+  for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+    int n = std::min<size_t>(IOV_MAX, iov.size() - i);
+    size_t want = 0;
+    for (int j = 0; j < n; j++)
+      want += iov[i + j].iov_len;
+
+    ssize_t ret = io(&iov[i], n, done);
+    if (ret < 0)
+      return done ? done : ret;
+    done += ret;
+    if ((size_t)ret < want)
+      break;
+  }
+  return done;
+}
+
 reg_t syscall_t::sys_read(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
+  std::vector<struct iovec> iov;
+  if (memif->host_iovecs(pbuf, len, true, iov)) {
+    int host_fd = fds.lookup(fd);
+    return sysret_errno(iov_transfer(iov, [&](const struct iovec* v, int n, ssize_t) {
+      return readv(host_fd, v, n);
+    }));
+  }
+
   std::vector<char> buf(len);
   ssize_t ret = read(fds.lookup(fd), buf.data(), len);
   reg_t ret_errno = sysret_errno(ret);
@@ -241,6 +273,14 @@ reg_t syscall_t::sys_read(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, r
 
 reg_t syscall_t::sys_pread(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4, reg_t a5, reg_t a6)
 {
+  std::vector<struct iovec> iov;
+  if (memif->host_iovecs(pbuf, len, true, iov)) {
+    int host_fd = fds.lookup(fd);
+    return sysret_errno(iov_transfer(iov, [&](const struct iovec* v, int n, ssize_t done) {
+      return preadv(host_fd, v, n, off + done);
+    }));
+  }
+
   std::vector<char> buf(len);
   ssize_t ret = pread(fds.lookup(fd), buf.data(), len, off);
   reg_t ret_errno = sysret_errno(ret);
@@ -251,6 +291,14 @@ reg_t syscall_t::sys_pread(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4,
 
 reg_t syscall_t::sys_write(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
+  std::vector<struct iovec> iov;
+  if (memif->host_iovecs(pbuf, len, false, iov)) {
+    int host_fd = fds.lookup(fd);
+    return sysret_errno(iov_transfer(iov, [&](const struct iovec* v, int n, ssize_t) {
+      return writev(host_fd, v, n);
+    }));
+  }
+
   std::vector<char> buf(len);
   memif->read(pbuf, len, buf.data());
   reg_t ret = sysret_errno(write(fds.lookup(fd), buf.data(), len));
@@ -259,6 +307,14 @@ reg_t syscall_t::sys_write(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4,
 
 reg_t syscall_t::sys_pwrite(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4, reg_t a5, reg_t a6)
 {
+  std::vector<struct iovec> iov;
+  if (memif->host_iovecs(pbuf, len, false, iov)) {
+    int host_fd = fds.lookup(fd);
+    return sysret_errno(iov_transfer(iov, [&](const struct iovec* v, int n, ssize_t done) {
+      return pwritev(host_fd, v, n, off + done);
+    }));
+  }
+
   std::vector<char> buf(len);
   memif->read(pbuf, len, buf.data());
   reg_t ret = sysret_errno(pwrite(fds.lookup(fd), buf.data(), len, off));
@@ -5,10 +5,16 @@
 #include <cstdint>
 #include <cstddef>
 
+class checkpoint_out_t;
+class checkpoint_in_t;
+
 class abstract_device_t {
  public:
   virtual bool load(reg_t addr, size_t len, uint8_t* bytes) = 0;
   virtual bool store(reg_t addr, size_t len, const uint8_t* bytes) = 0;
+  // device state for checkpoints; stateless devices need not override these
+  virtual void save(checkpoint_out_t&) {}
+  virtual void restore(checkpoint_in_t&) {}
   virtual ~abstract_device_t() {}
 };
 
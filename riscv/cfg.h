@@ -96,6 +96,7 @@ public:
   endianness_t                       endianness;
   reg_t                              pmpregions;
   cfg_arg_t<std::vector<mem_cfg_t>>  mem_layout;
+  std::vector<mem_cfg_t>             reserved_mem; // kept from the OS in the DTB
   std::optional<reg_t>               start_pc;
   cfg_arg_t<std::vector<size_t>>     hartids;
   bool                               explicit_hartids;
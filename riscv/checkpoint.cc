@@ -0,0 +1,302 @@
+// See LICENSE for license details.
+
+#include "config.h"
+#include "checkpoint.h"
+#include "sim.h"
+#include "mmu.h"
+#include "extension.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+
+// A checkpoint file starts with the magic string, the length of the state
+// that follows and the state itself: configuration, harts, devices and
+// HTIF. Then come the images of the memory regions, each at a page-aligned
+// offset so that it can be mapped copy-on-write, and with zero pages left
+// as holes.
+#define CHECKPOINT_MAGIC "spikechk"
+
+// CSRs that are not restored by writing them back one by one
+static bool csr_restored_separately(reg_t addr)
+{
+  return (addr >> 10) == 3 ||                           // read-only
+         addr == CSR_MIP ||                             // has hardware bits
+         addr == CSR_MCYCLE || addr == CSR_MCYCLEH ||   // written minus one
+         addr == CSR_MINSTRET || addr == CSR_MINSTRETH ||
+         (addr >= CSR_TDATA1 && addr <= CSR_TDATA3) ||  // per trigger
+         addr == CSR_SEED;                              // reads draw entropy
+}
+
+void processor_t::save(checkpoint_out_t& out)
+{
+  out.put(state.pc);
+  for (size_t i = 0; i < NXPR; i++)
+    out.put(state.XPR[i]);
+  for (size_t i = 0; i < NFPR; i++)
+    out.put(state.FPR[i]);
+  out.put(state.prv);
+  out.put(state.v);
+  out.put(state.debug_mode);
+  out.put(state.serialized);
+  out.put(state.single_step);
+  out.put(in_wfi);
+  out.put(halt_request);
+
+  std::vector<reg_t> csrs;
+  for (auto& it : state.csrmap)
+    csrs.push_back(it.first);
+  std::sort(csrs.begin(), csrs.end());
+  out.put<uint64_t>(csrs.size());
+  for (reg_t addr : csrs) {
+    out.put(addr);
+    out.put(addr == CSR_SEED ? 0 : state.csrmap[addr]->read());
+  }
+  out.put(state.mcycle->read());
+  out.put(state.minstret->read());
+
+  out.put<uint64_t>(TM.count());
+  for (unsigned i = 0; i < TM.count(); i++) {
+    out.put(TM.tdata1_read(i));
+    out.put(TM.tdata2_read(i));
+    out.put(TM.tdata3_read(i));
+  }
+
+  if (VU.vl)
+    out.put_bytes(VU.reg_file, NVPR * VU.vlenb);
+
+  std::map<std::string, extension_t*> extensions(custom_extensions.begin(),
+                                                 custom_extensions.end());
+  out.put<uint64_t>(extensions.size());
+  for (auto& it : extensions) {
+    std::ostringstream blob;
+    checkpoint_out_t ext_out(blob);
+    it.second->save(ext_out);
+    out.put(it.first);
+    out.put(blob.str());
+  }
+}
+
+void processor_t::restore(checkpoint_in_t& in)
+{
+  in.get(state.pc);
+  for (size_t i = 0; i < NXPR; i++)
+    state.XPR.write(i, in.get<reg_t>());
+  for (size_t i = 0; i < NFPR; i++)
+    state.FPR.write(i, in.get<freg_t>());
+  reg_t prv = in.get<reg_t>();
+  bool v = in.get<bool>();
+  in.get(state.debug_mode);
+  in.get(state.serialized);
+  in.get(state.single_step);
+  in.get(in_wfi);
+  in.get(halt_request);
+
+  std::map<reg_t, reg_t> csrs;
+  for (uint64_t n = in.get<uint64_t>(); n > 0; n--) {
+    reg_t addr = in.get<reg_t>();
+    csrs[addr] = in.get<reg_t>();
+    if (!state.csrmap.count(addr))
+      throw std::runtime_error("checkpoint has a CSR this hart lacks");
+  }
+
+  // Write the CSRs as M-mode outside of virtualization, so that virtualized
+  // CSRs reach their own registers. The FP and vector CSRs can only be
+  // written with their state enabled in mstatus, which is written again,
+  // as saved, after them. vl and vtype are read-only and are set the way
+  // vsetvl would set them. PMP addresses go before the configurations that
+  // may lock them.
+  state.prv = PRV_M;
+  state.v = false;
+  state.mstatus->write(csrs[CSR_MSTATUS] | MSTATUS_FS | MSTATUS_VS);
+  if (VU.vl)
+    VU.set_vl(1, 1, csrs[CSR_VL], csrs[CSR_VTYPE]);
+  for (auto& it : csrs)
+    if (it.first >= CSR_PMPADDR0 && it.first <= CSR_PMPADDR63)
+      state.csrmap[it.first]->write(it.second);
+  for (auto& it : csrs)
+    if (!csr_restored_separately(it.first))
+      state.csrmap[it.first]->write(it.second);
+  state.mip->backdoor_write_with_mask(~reg_t(0), csrs[CSR_MIP]);
+  state.mcycle->write(in.get<reg_t>() + 1);
+  state.minstret->write(in.get<reg_t>() + 1);
+
+  in.expect<uint64_t>(TM.count(), "trigger count");
+  for (unsigned i = 0; i < TM.count(); i++) {
+    TM.tdata1_write(i, in.get<reg_t>());
+    TM.tdata2_write(i, in.get<reg_t>());
+    TM.tdata3_write(i, in.get<reg_t>());
+  }
+
+  state.prv = prv;
+  state.v = v;
+  state.log_reg_write.clear();
+
+  if (VU.vl)
+    in.get_bytes(VU.reg_file, NVPR * VU.vlenb);
+
+  in.expect<uint64_t>(custom_extensions.size(), "set of extensions");
+  for (size_t i = 0; i < custom_extensions.size(); i++) {
+    std::string name, blob;
+    in.get(name);
+    in.get(blob);
+    if (!custom_extensions.count(name))
+      throw std::runtime_error("checkpoint has state of unknown extension " + name);
+    std::istringstream blob_in(blob);
+    checkpoint_in_t ext_in(blob_in);
+    custom_extensions[name]->restore(ext_in);
+  }
+
+  mmu->yield_load_reservation();
+  mmu->flush_tlb();
+  mmu->flush_icache();
+}
+
+static std::string error_string(const std::string& what)
+{
+  return what + ": " + strerror(errno);
+}
+
+void sim_t::save_checkpoint(const std::string& path)
+{
+  std::ostringstream state;
+  checkpoint_out_t out(state);
+
+  out.put(std::string(cfg->isa()));
+  out.put<uint64_t>(procs.size());
+  out.put<uint64_t>(mems.size());
+  for (auto& m : mems) {
+    out.put(m.first);
+    out.put(m.second->size());
+  }
+
+  for (processor_t* proc : procs)
+    proc->save(out);
+  out.put<uint64_t>(current_step);
+  out.put<uint64_t>(current_proc);
+
+  if (clint)
+    clint->save(out);
+  if (plic)
+    plic->save(out);
+  if (ns16550)
+    ns16550->save(out);
+  for (auto& dev : plugin_devices)
+    dev.second->save(out);
+
+  std::queue<reg_t> pending = get_fromhost_queue();
+  out.put<uint64_t>(pending.size());
+  for (; !pending.empty(); pending.pop())
+    out.put(pending.front());
+
+  // Write to a new file and rename it over the old one: a run restored
+  // from the old checkpoint may still have it mapped.
+  std::string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error(error_string("can't create " + tmp_path));
+
+  std::string header = CHECKPOINT_MAGIC;
+  uint64_t state_size = state.str().size();
+  header.append((const char*)&state_size, sizeof(state_size));
+  header += state.str();
+  bool ok = write(fd, header.data(), header.size()) == (ssize_t)header.size();
+
+  off_t offset = (header.size() + PGSIZE - 1) & ~(off_t)(PGSIZE - 1);
+  for (auto& m : mems) {
+    ok = ok && m.second->save_image(fd, offset);
+    offset += m.second->size();
+  }
+  ok = ok && ftruncate(fd, offset) == 0;
+
+  if (close(fd) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    throw std::runtime_error(error_string("can't write " + path));
+}
+
+void sim_t::restore_checkpoint(const std::string& path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(error_string("can't open " + path));
+
+  char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+  uint64_t state_size;
+  if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+      memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+      read(fd, &state_size, sizeof(state_size)) != sizeof(state_size))
+    throw std::runtime_error(path + " is not a checkpoint");
+  std::string state(state_size, 0);
+  if (read(fd, &state[0], state_size) != (ssize_t)state_size)
+    throw std::runtime_error("checkpoint is truncated");
+
+  std::istringstream state_in(state);
+  checkpoint_in_t in(state_in);
+
+  std::string isa_string;
+  in.get(isa_string);
+  if (isa_string != cfg->isa())
+    throw std::runtime_error("checkpoint has a different ISA (" + isa_string + ")");
+  in.expect<uint64_t>(procs.size(), "number of harts");
+  in.expect<uint64_t>(mems.size(), "memory layout");
+  for (auto& m : mems) {
+    in.expect(m.first, "memory layout");
+    in.expect(m.second->size(), "memory layout");
+  }
+
+  off_t offset = (sizeof(magic) + sizeof(state_size) + state_size + PGSIZE - 1) & ~(off_t)(PGSIZE - 1);
+  for (auto& m : mems) {
+    if (!m.second->restore_image(fd, offset))
+      throw std::runtime_error(error_string("can't read memory from " + path));
+    offset += m.second->size();
+  }
+  close(fd);
+
+  for (processor_t* proc : procs)
+    proc->restore(in);
+  current_step = in.get<uint64_t>();
+  current_proc = in.get<uint64_t>();
+
+  if (clint)
+    clint->restore(in);
+  if (plic)
+    plic->restore(in);
+  if (ns16550)
+    ns16550->restore(in);
+  for (auto& dev : plugin_devices)
+    dev.second->restore(in);
+
+  std::queue<reg_t> pending;
+  for (uint64_t n = in.get<uint64_t>(); n > 0; n--)
+    pending.push(in.get<reg_t>());
+  get_fromhost_queue() = pending;
+
+  // memory changed behind the MMUs' backs
+  debug_mmu->flush_tlb();
+  for (auto& it : page_write_gen)
+    it.second = ++page_write_clock;
+}
+
+void sim_t::set_checkpointing(size_t interval, const char* path)
+{
+  checkpoint_interval = checkpoint_countdown = interval;
+  checkpoint_path = path;
+}
+
+void sim_t::tick_checkpoint(size_t insns)
+{
+  if (!checkpoint_interval)
+    return;
+  if (insns < checkpoint_countdown) {
+    checkpoint_countdown -= insns;
+    return;
+  }
+
+  checkpoint_countdown = checkpoint_interval;
+  try {
+    save_checkpoint(checkpoint_path);
+  } catch (std::runtime_error& e) {
+    fprintf(stderr, "warning: checkpoint failed: %s\n", e.what());
+  }
+}
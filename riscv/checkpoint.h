@@ -0,0 +1,74 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CHECKPOINT_H
+#define _RISCV_CHECKPOINT_H
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Streams for the state in a checkpoint (see sim_t::save_checkpoint).
+// Values are stored as raw bytes in host order, so a checkpoint is meant
+// to be restored by the same build of spike, on the same command line.
+class checkpoint_out_t
+{
+public:
+  checkpoint_out_t(std::ostream& o) : o(o) {}
+
+  void put_bytes(const void* data, size_t len) { o.write((const char*)data, len); }
+  template<typename T> void put(const T& val)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "not raw data");
+    put_bytes(&val, sizeof(val));
+  }
+  void put(const std::string& s)
+  {
+    put<uint64_t>(s.size());
+    put_bytes(s.data(), s.size());
+  }
+
+private:
+  std::ostream& o;
+};
+
+class checkpoint_in_t
+{
+public:
+  checkpoint_in_t(std::istream& i) : i(i) {}
+
+  void get_bytes(void* data, size_t len)
+  {
+    if (!i.read((char*)data, len))
+      throw std::runtime_error("checkpoint is truncated");
+  }
+  template<typename T> void get(T& val)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "not raw data");
+    get_bytes(&val, sizeof(val));
+  }
+  template<typename T> T get()
+  {
+    T val;
+    get(val);
+    return val;
+  }
+  void get(std::string& s)
+  {
+    s.resize(get<uint64_t>());
+    get_bytes(&s[0], s.size());
+  }
+
+  // read a value that must be as expected, e.g. a hart count
+  template<typename T> void expect(const T& val, const char* what)
+  {
+    if (get<T>() != val)
+      throw std::runtime_error(std::string("checkpoint has a different ") + what);
+  }
+
+private:
+  std::istream& i;
+};
+
+#endif
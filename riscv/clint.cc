@@ -2,6 +2,7 @@
 #include "devices.h"
 #include "processor.h"
 #include "simif.h"
+#include "checkpoint.h"
 
 clint_t::clint_t(simif_t* sim, uint64_t freq_hz, bool real_time)
   : sim(sim), freq_hz(freq_hz), real_time(real_time), mtime(0)
@@ -112,3 +113,24 @@ void clint_t::increment(reg_t inc)
     hart->state.mip->backdoor_write_with_mask(MIP_MTIP, mtime >= mtimecmp[hart_id] ? MIP_MTIP : 0);
   }
 }
+
+void clint_t::save(checkpoint_out_t& out)
+{
+  out.put(mtime);
+  out.put<uint64_t>(mtimecmp.size());
+  for (auto& it : mtimecmp) {
+    out.put<uint64_t>(it.first);
+    out.put(it.second);
+  }
+}
+
+void clint_t::restore(checkpoint_in_t& in)
+{
+  in.get(mtime);
+  mtimecmp.clear();
+  for (uint64_t n = in.get<uint64_t>(); n > 0; n--) {
+    size_t hart_id = in.get<uint64_t>();
+    in.get(mtimecmp[hart_id]);
+  }
+  increment(0);
+}
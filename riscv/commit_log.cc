@@ -0,0 +1,163 @@
+// See LICENSE for license details.
+
+#include "commit_log.h"
+#include "processor.h"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+commit_log_writer_t::commit_log_writer_t(const char* path)
+  : ring(new uint8_t[RING_SIZE])
+{
+  size_t len = strlen(path);
+  piped = len > 3 && strcmp(path + len - 3, ".gz") == 0;
+  if (piped)
+    file = popen(("gzip -c > '" + std::string(path) + "'").c_str(), "w");
+  else
+    file = fopen(path, "wb");
+  if (!file) {
+    std::ostringstream oss;
+    oss << "Failed to open commit log at `" << path << "': "
+        << strerror (errno);
+    throw std::runtime_error(oss.str());
+  }
+  fwrite(COMMIT_LOG_MAGIC, 1, strlen(COMMIT_LOG_MAGIC), file);
+
+  writer = std::thread([this] { drain(); });
+}
+
+commit_log_writer_t::~commit_log_writer_t()
+{
+  done.store(true, std::memory_order_release);
+  writer.join();
+  if (piped)
+    pclose(file);
+  else
+    fclose(file);
+}
+
+void commit_log_writer_t::drain()
+{
+  while (true) {
+    // a producer that is done has published everything before saying so
+    bool finished = done.load(std::memory_order_acquire);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (h == t) {
+      if (finished)
+        return;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    size_t start = t % RING_SIZE;
+    size_t len = std::min(h - t, RING_SIZE - start);
+    fwrite(&ring[start], 1, len, file);
+    tail.store(t + len, std::memory_order_release);
+  }
+}
+
+void commit_log_writer_t::put_varint(uint64_t v)
+{
+  while (v >= 0x80) {
+    rec.push_back((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  rec.push_back(v);
+}
+
+void commit_log_writer_t::put_bytes(const void* data, size_t len)
+{
+  rec.insert(rec.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+}
+
+void commit_log_writer_t::publish()
+{
+  size_t h = head.load(std::memory_order_relaxed);
+  while (RING_SIZE - (h - tail.load(std::memory_order_acquire)) < rec.size())
+    std::this_thread::yield();
+
+  size_t start = h % RING_SIZE;
+  size_t first = std::min(rec.size(), RING_SIZE - start);
+  memcpy(&ring[start], rec.data(), first);
+  memcpy(&ring[0], rec.data() + first, rec.size() - first);
+  head.store(h + rec.size(), std::memory_order_release);
+}
+
+void commit_log_writer_t::record(processor_t* p, reg_t pc, insn_t insn)
+{
+  state_t* state = p->get_state();
+  int xlen = state->last_inst_xlen;
+  int flen = state->last_inst_flen;
+
+  rec.clear();
+  put_varint(p->get_id());
+  put_varint(state->last_inst_priv);
+  put_varint(xlen);
+  put_varint(flen);
+  put_svarint(pc - last_pc);
+  last_pc = pc;
+  put_varint(insn.bits());
+
+  // x0 is never printed, so it is not recorded either
+  size_t writes = 0;
+  bool vector = false;
+  for (auto& item : state->log_reg_write) {
+    if (item.first == 0)
+      continue;
+    writes++;
+    vector |= (item.first & 0xf) == 2 || (item.first & 0xf) == 3;
+  }
+  put_varint(writes * 2 + vector);
+  if (vector) {
+    put_varint(p->VU.vsew);
+    put_svarint(p->VU.vflmul < 1 ? -(int64_t)(1 / p->VU.vflmul) : (int64_t)p->VU.vflmul);
+    put_varint(p->VU.vl->read());
+    put_varint(p->VU.VLEN);
+  }
+  for (auto& item : state->log_reg_write) {
+    if (item.first == 0)
+      continue;
+    put_varint(item.first);
+    switch (item.first & 0xf) {
+      case 0:
+      case 4:
+        put_bytes(item.second.v, xlen / 8);
+        break;
+      case 1:
+        put_bytes(item.second.v, flen / 8);
+        break;
+      case 2:
+        put_bytes(&p->VU.elt<uint8_t>(item.first >> 4, 0), p->VU.VLEN / 8);
+        break;
+    }
+  }
+
+  put_varint(state->log_ext_write.size());
+  for (auto& item : state->log_ext_write) {
+    const char* name = std::get<0>(item);
+    auto& data = std::get<2>(item);
+    put_varint(strlen(name));
+    put_bytes(name, strlen(name));
+    put_varint(std::get<1>(item));
+    put_varint(data.size());
+    put_bytes(data.data(), data.size());
+  }
+
+  put_varint(state->log_mem_read.size());
+  for (auto& item : state->log_mem_read)
+    put_varint(std::get<0>(item));
+
+  put_varint(state->log_mem_write.size());
+  for (auto& item : state->log_mem_write) {
+    uint64_t data = std::get<1>(item);
+    size_t size = std::min<size_t>(std::get<2>(item), sizeof(data));
+    put_varint(std::get<0>(item));
+    put_varint(size);
+    put_bytes(&data, size);
+  }
+
+  publish();
+}
@@ -0,0 +1,68 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COMMIT_LOG_H
+#define _RISCV_COMMIT_LOG_H
+
+#include "decode.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class processor_t;
+
+// Binary commit log, written by --log-commits-bin. After the magic
+// string comes one record per committed instruction, with every number
+// stored as a LEB128 varint (s: zigzag-signed) unless it is given as
+// bytes, which are little-endian:
+//
+//   core, privilege, xlen, flen
+//   s: pc minus the pc of the previous record (0 for the first)
+//   instruction bits
+//   twice the number of register writes, plus 1 if any of them is to a
+//   vector register, in which case the vector state follows: vsew,
+//   s: lmul (-n for 1/n), vl, VLEN; then per write its key (as in
+//   log_reg_write) and value: xlen/8 bytes for x and CSR writes, flen/8
+//   for f writes, VLEN/8 for v writes, none for the rest
+//   number of extension writes; each: name length, name, index, number of
+//   bytes, bytes (e.g. FIONA's fv/fm records)
+//   number of loads; each: address
+//   number of stores; each: address, size, size bytes of data
+//
+// spike-commit-log turns such a file back into the --log-commits text.
+#define COMMIT_LOG_MAGIC "spikeclg"
+
+// Records are encoded on the simulation thread into a ring buffer, and a
+// writer thread empties the ring into the file. The ring has a single
+// producer, as harts log on one thread, and a single consumer, so it needs
+// no lock. A path ending in .gz is written through gzip.
+class commit_log_writer_t
+{
+public:
+  commit_log_writer_t(const char* path);
+  ~commit_log_writer_t();
+
+  void record(processor_t* p, reg_t pc, insn_t insn);
+
+private:
+  static const size_t RING_SIZE = 1 << 24;
+
+  void put_varint(uint64_t v);
+  void put_svarint(int64_t v) { put_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+  void put_bytes(const void* data, size_t len);
+  void publish();
+  void drain();
+
+  FILE* file;
+  bool piped;
+  std::vector<uint8_t> rec; // record being encoded
+  reg_t last_pc = 0;
+
+  std::unique_ptr<uint8_t[]> ring;
+  std::atomic<size_t> head{0}; // bytes produced
+  std::atomic<size_t> tail{0}; // bytes written out
+  std::atomic<bool> done{false};
+  std::thread writer;
+};
+
+#endif
@@ -435,7 +435,7 @@ void base_status_csr_t::maybe_flush_tlb(const reg_t newval) noexcept {
       (MSTATUS_MPP | MSTATUS_MPRV
        | (has_page ? (MSTATUS_MXR | MSTATUS_SUM) : 0)
       ))
-    proc->get_mmu()->flush_tlb();
+    proc->get_mmu()->flush_tlb_context();
 }
 
 namespace {
@@ -687,6 +687,10 @@ bool misa_csr_t::unlogged_write(const reg_t val) noexcept {
     }
   }
 
+  // decoded and compiled blocks assume the IALIGN they were built with
+  if ((new_misa ^ old_misa) & (1L << ('C' - 'A')))
+    proc->get_mmu()->flush_icache();
+
   return basic_csr_t::unlogged_write(new_misa);
 }
 
@@ -912,7 +916,7 @@ base_atp_csr_t::base_atp_csr_t(processor_t* const proc, const reg_t addr):
 bool base_atp_csr_t::unlogged_write(const reg_t val) noexcept {
   const reg_t newval = proc->supports_impl(IMPL_MMU) ? compute_new_satp(val) : 0;
   if (newval != read())
-    proc->get_mmu()->flush_tlb();
+    proc->get_mmu()->flush_tlb_context();
   return basic_csr_t::unlogged_write(newval);
 }
 
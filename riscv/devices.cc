@@ -1,6 +1,9 @@
 #include "devices.h"
 #include "mmu.h"
+#include <cerrno>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
 
 void bus_t::add_device(reg_t addr, abstract_device_t* dev)
 {
@@ -91,15 +94,47 @@ bool mmio_plugin_device_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   return (*plugin.store)(user_data, addr, len, bytes);
 }
 
-mem_t::mem_t(reg_t size)
+mem_t::mem_t(reg_t size, bool huge_pages)
   : sz(size)
 {
   if (size == 0 || size % PGSIZE != 0)
     throw std::runtime_error("memory size must be a positive multiple of 4 KiB");
+
+  if (size != (size_t)size)
+    return;
+
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (huge_pages) {
+    // hugetlbfs mappings must be a whole number of (2 MiB) huge pages, and
+    // must reserve them up front: without enough free huge pages, touching
+    // a MAP_NORESERVE mapping raises SIGBUS rather than mmap failing
+    const size_t huge_page_size = 2 << 20;
+    flat_memory_size = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+    p = mmap(NULL, flat_memory_size, PROT_READ | PROT_WRITE,
+             (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+    flat_memory_hugetlb = p != MAP_FAILED;
+  }
+#endif
+  if (p == MAP_FAILED) {
+    flat_memory_size = size;
+    p = mmap(NULL, flat_memory_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED)
+      return;
+#ifdef MADV_HUGEPAGE
+    // no hugetlbfs pages reserved, so ask for transparent huge pages
+    if (huge_pages)
+      madvise(p, flat_memory_size, MADV_HUGEPAGE);
+#endif
+  }
+  flat_memory = (char*)p;
 }
 
 mem_t::~mem_t()
 {
+  if (flat_memory)
+    munmap(flat_memory, flat_memory_size);
   for (auto& entry : sparse_memory_map)
     free(entry.second);
 }
@@ -109,6 +144,14 @@ bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
   if (addr + len < addr || addr + len > sz)
     return false;
 
+  if (flat_memory) {
+    if (store)
+      memcpy(flat_memory + addr, bytes, len);
+    else
+      memcpy(bytes, flat_memory + addr, len);
+    return true;
+  }
+
   while (len > 0) {
     auto n = std::min(PGSIZE - (addr % PGSIZE), reg_t(len));
 
@@ -125,8 +168,41 @@ bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
   return true;
 }
 
+bool mem_t::clear(reg_t addr, size_t len)
+{
+  static const char zeros[PGSIZE] = {};
+
+  if (addr + len < addr || addr + len > sz)
+    return false;
+
+  // Pages that were never written are not allocated (or, in the mapping,
+  // not backed), and zeroing them would only change that.
+  while (len > 0) {
+    auto n = std::min(PGSIZE - (addr % PGSIZE), reg_t(len));
+
+    if (flat_memory) {
+      if (memcmp(flat_memory + addr, zeros, n) != 0)
+        memset(flat_memory + addr, 0, n);
+    } else {
+      std::lock_guard<std::mutex> lock(sparse_memory_lock);
+      auto search = sparse_memory_map.find(addr >> PGSHIFT);
+      if (search != sparse_memory_map.end())
+        memset(search->second + addr % PGSIZE, 0, n);
+    }
+
+    addr += n;
+    len -= n;
+  }
+
+  return true;
+}
+
 char* mem_t::contents(reg_t addr) {
+  if (flat_memory)
+    return flat_memory + addr;
+
   reg_t ppn = addr >> PGSHIFT, pgoff = addr % PGSIZE;
+  std::lock_guard<std::mutex> lock(sparse_memory_lock);
   auto search = sparse_memory_map.find(ppn);
   if (search == sparse_memory_map.end()) {
     auto res = (char*)calloc(PGSIZE, 1);
@@ -139,6 +215,11 @@ char* mem_t::contents(reg_t addr) {
 }
 
 void mem_t::dump(std::ostream& o) {
+  if (flat_memory) {
+    o.write(flat_memory, sz);
+    return;
+  }
+
   const char empty[PGSIZE] = {0};
   for (reg_t i = 0; i < sz; i += PGSIZE) {
     reg_t ppn = i >> PGSHIFT;
@@ -150,3 +231,56 @@ void mem_t::dump(std::ostream& o) {
     }
   }
 }
+
+static bool is_zero_page(const char* page)
+{
+  static const char zero[PGSIZE] = {0};
+  return memcmp(page, zero, PGSIZE) == 0;
+}
+
+bool mem_t::save_image(int fd, off_t offset)
+{
+  for (reg_t i = 0; i < sz; i += PGSIZE) {
+    const char* page;
+    if (flat_memory) {
+      page = flat_memory + i;
+    } else {
+      auto search = sparse_memory_map.find(i >> PGSHIFT);
+      if (search == sparse_memory_map.end())
+        continue;
+      page = search->second;
+    }
+    if (!is_zero_page(page) && pwrite(fd, page, PGSIZE, offset + i) != (ssize_t)PGSIZE)
+      return false;
+  }
+  return true;
+}
+
+bool mem_t::map_file(reg_t addr, size_t len, int fd, off_t offset)
+{
+  if (addr % PGSIZE || addr + len < addr || addr + len > sz) {
+    errno = EINVAL;
+    return false;
+  }
+
+  // only the pages the program touches are then read in, and only those
+  // it writes are copied (hugetlbfs mappings can't be split like this)
+  size_t map_len = (len + PGSIZE - 1) & ~(PGSIZE - 1);
+  if (flat_memory && !flat_memory_hugetlb &&
+      mmap(flat_memory + addr, map_len, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED)
+    return true;
+
+  char page[PGSIZE];
+  for (reg_t i = 0; i < len; i += PGSIZE) {
+    size_t n = std::min(PGSIZE, reg_t(len - i));
+    if (pread(fd, page, n, offset + i) != (ssize_t)n)
+      return false;
+    memset(page + n, 0, PGSIZE - n);
+    // leave unallocated sparse pages alone if they stay zero
+    if (!flat_memory && is_zero_page(page) && !sparse_memory_map.count((addr + i) >> PGSHIFT))
+      continue;
+    memcpy(contents(addr + i), page, PGSIZE);
+  }
+  return true;
+}
@@ -7,10 +7,12 @@
 #include "abstract_interrupt_controller.h"
 #include "platform.h"
 #include <map>
+#include <mutex>
 #include <queue>
 #include <vector>
 #include <utility>
 #include <cassert>
+#include <sys/types.h>
 
 class processor_t;
 class simif_t;
@@ -37,22 +39,41 @@ class rom_device_t : public abstract_device_t {
   std::vector<char> data;
 };
 
+// Guest RAM. The whole region is normally reserved with one anonymous
+// mmap, which the kernel zero-fills as pages are first touched, so an
+// address is found by adding it to the base of the mapping. If the region
+// is too large to map, pages are allocated one by one on first use.
 class mem_t : public abstract_device_t {
  public:
-  mem_t(reg_t size);
+  // huge_pages backs the mapping with huge pages if the host allows it
+  mem_t(reg_t size, bool huge_pages = false);
   mem_t(const mem_t& that) = delete;
   ~mem_t();
 
   bool load(reg_t addr, size_t len, uint8_t* bytes) { return load_store(addr, len, bytes, false); }
   bool store(reg_t addr, size_t len, const uint8_t* bytes) { return load_store(addr, len, const_cast<uint8_t*>(bytes), true); }
+  // zero a range, leaving pages that are still zero untouched
+  bool clear(reg_t addr, size_t len);
   char* contents(reg_t addr);
   reg_t size() { return sz; }
   void dump(std::ostream& o);
+  // Write the contents to fd at offset, skipping zero pages, or replace
+  // them with what is there. These return false with errno set on failure.
+  bool save_image(int fd, off_t offset);
+  bool restore_image(int fd, off_t offset) { return map_file(0, sz, fd, offset); }
+  // Replace len bytes from the page at addr with what is in fd at offset,
+  // mapping the file copy-on-write if possible. The rest of the last page
+  // is zeroed.
+  bool map_file(reg_t addr, size_t len, int fd, off_t offset);
 
  private:
   bool load_store(reg_t addr, size_t len, uint8_t* bytes, bool store);
 
+  char* flat_memory = nullptr; // the mapping, if there is one
+  size_t flat_memory_size = 0;
+  bool flat_memory_hugetlb = false;
   std::map<reg_t, char*> sparse_memory_map;
+  std::mutex sparse_memory_lock;  // pages are allocated by any hart thread
   reg_t sz;
 };
 
@@ -65,6 +86,8 @@ class clint_t : public abstract_device_t {
   void increment(reg_t inc);
   uint64_t get_mtimecmp(reg_t hartid) { return mtimecmp[hartid]; }
   uint64_t get_mtime() { return mtime; }
+  void save(checkpoint_out_t& out);
+  void restore(checkpoint_in_t& in);
  private:
   typedef uint64_t mtime_t;
   typedef uint64_t mtimecmp_t;
@@ -102,6 +125,8 @@ class plic_t : public abstract_device_t, public abstract_interrupt_controller_t
   bool store(reg_t addr, size_t len, const uint8_t* bytes);
   void set_interrupt_level(uint32_t id, int lvl);
   size_t size() { return PLIC_SIZE; }
+  void save(checkpoint_out_t& out);
+  void restore(checkpoint_in_t& in);
  private:
   std::vector<plic_context_t> contexts;
   uint32_t num_ids;
@@ -133,6 +158,8 @@ class ns16550_t : public abstract_device_t {
   bool store(reg_t addr, size_t len, const uint8_t* bytes);
   void tick(void);
   size_t size() { return NS16550_SIZE; }
+  void save(checkpoint_out_t& out);
+  void restore(checkpoint_in_t& in);
  private:
   class bus_t *bus;
   abstract_interrupt_controller_t *intctrl;
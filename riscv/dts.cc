@@ -17,7 +17,8 @@ std::string make_dts(size_t insns_per_rtc_tick, size_t cpu_hz,
                      const char* bootargs,
                      size_t pmpregions,
                      std::vector<processor_t*> procs,
-                     std::vector<std::pair<reg_t, mem_t*>> mems)
+                     std::vector<std::pair<reg_t, mem_t*>> mems,
+                     const std::vector<mem_cfg_t>& reserved_mem)
 {
   std::stringstream s;
   s << std::dec <<
@@ -80,6 +81,21 @@ std::string make_dts(size_t insns_per_rtc_tick, size_t cpu_hz,
                    " 0x" << (m.second->size() >> 16 >> 16) << " 0x" << (m.second->size() & (uint32_t)-1) << ">;\n"
          "  };\n";
   }
+  if (!reserved_mem.empty()) {
+    s << "  reserved-memory {\n"
+         "    #address-cells = <2>;\n"
+         "    #size-cells = <2>;\n"
+         "    ranges;\n";
+    for (auto& r : reserved_mem) {
+      s << std::hex <<
+           "    blob@" << r.get_base() << " {\n"
+           "      reg = <0x" << (r.get_base() >> 32) << " 0x" << (r.get_base() & (uint32_t)-1) <<
+                     " 0x" << (r.get_size() >> 32) << " 0x" << (r.get_size() & (uint32_t)-1) << ">;\n"
+           "      no-map;\n"
+           "    };\n";
+    }
+    s << "  };\n";
+  }
   s <<   "  soc {\n"
          "    #address-cells = <2>;\n"
          "    #size-cells = <2>;\n"
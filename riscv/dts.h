@@ -12,7 +12,8 @@ std::string make_dts(size_t insns_per_rtc_tick, size_t cpu_hz,
                      const char* bootargs,
                      size_t pmpregions,
                      std::vector<processor_t*> procs,
-                     std::vector<std::pair<reg_t, mem_t*>> mems);
+                     std::vector<std::pair<reg_t, mem_t*>> mems,
+                     const std::vector<mem_cfg_t>& reserved_mem);
 
 std::string dts_compile(const std::string& dts);
 
@@ -3,6 +3,9 @@
 #include "config.h"
 #include "processor.h"
 #include "mmu.h"
+#include "jit.h"
+#include "profiler.h"
+#include "commit_log.h"
 #include "disasm.h"
 #include "decode_macros.h"
 #include <cassert>
@@ -12,6 +15,7 @@ static void commit_log_reset(processor_t* p)
   p->get_state()->log_reg_write.clear();
   p->get_state()->log_mem_read.clear();
   p->get_state()->log_mem_write.clear();
+  p->get_state()->log_ext_write.clear();
 }
 
 static void commit_log_stash_privilege(processor_t* p)
@@ -62,11 +66,20 @@ static void commit_log_print_value(FILE *log_file, int width, uint64_t val)
 
 static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
 {
+  if (p->log_filtered(insn))
+    return;
+
+  if (p->get_commit_log()) {
+    p->get_commit_log()->record(p, pc, insn);
+    return;
+  }
+
   FILE *log_file = p->get_log_file();
 
   auto& reg = p->get_state()->log_reg_write;
   auto& load = p->get_state()->log_mem_read;
   auto& store = p->get_state()->log_mem_write;
+  auto& ext = p->get_state()->log_ext_write;
   int priv = p->get_state()->last_inst_priv;
   int xlen = p->get_state()->last_inst_xlen;
   int flen = p->get_state()->last_inst_flen;
@@ -137,6 +150,13 @@ static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
     }
   }
 
+  for (auto& item : ext) {
+    auto& data = std::get<2>(item);
+    fprintf(log_file, " %s%-2d 0x", std::get<0>(item), (int)std::get<1>(item));
+    for (size_t i = data.size(); i > 0; i--)
+      fprintf(log_file, "%02" PRIx8, data[i - 1]);
+  }
+
   for (auto item : load) {
     fprintf(log_file, " mem ");
     commit_log_print_value(log_file, xlen, std::get<0>(item));
@@ -211,6 +231,8 @@ bool processor_t::slow_path()
 // fetch/decode/execute loop
 void processor_t::step(size_t n)
 {
+  yield_requested = false;
+
   if (!state.debug_mode) {
     if (halt_request == HR_REGULAR) {
       enter_debug_mode(DCSR_CAUSE_DEBUGINT);
@@ -222,6 +244,29 @@ void processor_t::step(size_t n)
     }
   }
 
+  if (likely(pc_sample_interval == 0)) {
+    step_insns(n);
+    return;
+  }
+
+  // Sampling cuts the run at each sample point, so the loops below never
+  // look at it. A hart that waits for an interrupt or yields returns early,
+  // and like sim_t we count the whole of n as spent.
+  while (n > 0) {
+    size_t chunk = std::min(n, pc_sample_countdown);
+    step_insns(chunk);
+    n -= chunk;
+    if ((pc_sample_countdown -= chunk) == 0) {
+      pc_samples.push_back(state.pc);
+      pc_sample_countdown = pc_sample_interval;
+    }
+    if (in_wfi || yield_requested)
+      break;
+  }
+}
+
+void processor_t::step_insns(size_t n)
+{
   while (n > 0) {
     size_t instret = 0;
     reg_t pc = state.pc;
@@ -243,6 +288,8 @@ void processor_t::step(size_t n)
 
     try
     {
+      // no block is running, so privilege changes on trap entry keep it
+      _mmu->running_block = NULL;
       take_pending_interrupt();
 
       if (unlikely(slow_path()))
@@ -250,6 +297,11 @@ void processor_t::step(size_t n)
         // Main simulation loop, slow path.
         while (instret < n)
         {
+          if (unlikely(yield_requested)) {
+            n = instret;
+            break;
+          }
+
           if (unlikely(!state.serialized && state.single_step == state.STEP_STEPPED)) {
             state.single_step = state.STEP_NONE;
             if (!state.debug_mode) {
@@ -282,28 +334,68 @@ void processor_t::step(size_t n)
             disasm(fetch.insn);
           pc = execute_insn_logged(this, pc, fetch);
           advance_pc();
+          if (unlikely(profiler != NULL))
+            profiler->retire(instret, fetch.insn, pc);
         }
       }
-      else while (instret < n)
+      else if (instret < n)
       {
-        // Main simulation loop, fast path.
-        for (auto ic_entry = _mmu->access_icache(pc); ; ) {
-          auto fetch = ic_entry->data;
-          pc = execute_insn_fast(this, pc, fetch);
-          ic_entry = ic_entry->next;
-          if (unlikely(ic_entry->tag != pc))
-            break;
-          if (unlikely(instret + 1 == n))
+        // Main simulation loop, fast path: run decoded blocks, leaving a
+        // block when an instruction does not fall through to the next one.
+        for (auto block = _mmu->access_block(pc); ; block = _mmu->next_block(block, pc)) {
+          size_t first = instret;
+          if (unlikely(jit != NULL)) {
+            if (block->jit && instret + block->size <= n) {
+              jit_exit_t exit = block->jit(jit->context(), pc);
+              if (unlikely(jit->context()->exception != nullptr)) {
+                // the instruction at state.pc threw and did not retire
+                instret += exit.count - 1;
+                pc = state.pc;
+                jit->rethrow();
+              }
+              instret += exit.count - 1;
+              pc = exit.pc;
+              advance_pc();
+              if (unlikely(profiler != NULL))
+                profiler->retire(instret, block->insns[instret - first - 1].fetch.insn, pc);
+              if (unlikely(yield_requested))
+                n = instret;
+              if (instret >= n)
+                break;
+              continue;
+            }
+            if (++block->hits == jit_t::HOT_THRESHOLD && block->paddr != (reg_t)-1)
+              jit->compile(block);
+          }
+
+#ifdef RISCV_THREADED_DISPATCH
+          execute_block_threaded(this, block, pc, instret, n);
+#else
+          reg_t start = pc;
+          for (size_t i = 0; ; ) {
+            pc = execute_insn_fast(this, pc, block->insns[i].fetch);
+            if (unlikely(pc != start + block->insns[i].end) || ++i >= block->size)
+              break;
+            if (unlikely(instret + 1 == n))
+              break;
+            instret++;
+            state.pc = pc;
+          }
+#endif
+
+          advance_pc();
+          if (unlikely(profiler != NULL))
+            profiler->retire(instret, block->insns[instret - first - 1].fetch.insn, pc);
+          if (unlikely(yield_requested))
+            n = instret;
+          if (instret >= n)
             break;
-          instret++;
-          state.pc = pc;
         }
-
-        advance_pc();
       }
     }
     catch(trap_t& t)
     {
+      _mmu->running_block = NULL;
       take_trap(t, pc);
       n = instret;
 
@@ -340,6 +432,9 @@ void processor_t::step(size_t n)
       in_wfi = true;
     }
 
+    if (unlikely(profiler != NULL))
+      profiler->end_step(instret);
+
     state.minstret->bump(instret);
 
     // Model a hart whose CPI is 1.
@@ -16,6 +16,9 @@ class extension_t
   virtual const char* name() = 0;
   virtual void reset() {};
   virtual void set_debug(bool UNUSED value) {}
+  // extension state for checkpoints (see checkpoint.h)
+  virtual void save(checkpoint_out_t& UNUSED out) {}
+  virtual void restore(checkpoint_in_t& UNUSED in) {}
   virtual ~extension_t();
 
   void set_processor(processor_t* _p) { p = _p; }
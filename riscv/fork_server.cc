@@ -0,0 +1,198 @@
+// See LICENSE for license details.
+
+#include "config.h"
+#include "sim.h"
+#include "mmu.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Fork-server protocol. A client connects to the Unix socket and sends its
+// stdin, stdout and stderr as SCM_RIGHTS with the first bytes of a request
+// of text lines:
+//
+//   env <name>=<value>          set an environment variable
+//   poke <symbol|addr> <value>  store a 64-bit value through hart 0's MMU
+//   run                         end of request
+//
+// The server forks a child that applies the request, takes over the
+// client's stdio and continues the simulation from where the server
+// stopped. When the program exits, the child sends "exit <code>\n" and the
+// connection closes; a connection that closes without it means the child
+// died. spike-fork is such a client.
+
+void sim_t::set_fork_server(const char* path, const char* marker)
+{
+  fork_server_path = path;
+  fork_marker = marker ? marker : "";
+}
+
+bool sim_t::reached_fork_point()
+{
+  if (fork_marker.empty())
+    return true;
+
+  if (!fork_pc) {
+    uint64_t addr;
+    char* end;
+    addr = strtoull(fork_marker.c_str(), &end, 0);
+    if (*end && !get_symbol_address(fork_marker, &addr)) {
+      fprintf(stderr, "--fork-at: no symbol %s\n", fork_marker.c_str());
+      exit(1);
+    }
+    fork_pc = addr;
+  }
+
+  // step one instruction at a time, so as to stop right at the marker
+  for (size_t i = 0; i < INTERLEAVE; i++) {
+    if (procs[0]->get_state()->pc == *fork_pc)
+      return true;
+    step(1);
+  }
+  return false;
+}
+
+static bool read_request(int conn, int fds[3], std::vector<std::string>& lines)
+{
+  std::string buf;
+  bool have_fds = false;
+  while (true) {
+    char data[4096];
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = { data, sizeof(data) };
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(conn, &msg, 0);
+    if (n <= 0)
+      return false;
+
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS &&
+          c->cmsg_len == CMSG_LEN(3 * sizeof(int)) && !have_fds) {
+        memcpy(fds, CMSG_DATA(c), 3 * sizeof(int));
+        have_fds = true;
+      }
+    }
+
+    buf.append(data, n);
+    size_t eol;
+    while ((eol = buf.find('\n')) != std::string::npos) {
+      std::string line = buf.substr(0, eol);
+      buf.erase(0, eol + 1);
+      if (line == "run")
+        return have_fds;
+      lines.push_back(line);
+    }
+  }
+}
+
+// In the child: apply one line of the request, or say what is wrong with it
+bool sim_t::apply_fork_request(const std::string& line)
+{
+  if (line.compare(0, 4, "env ") == 0) {
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+      return false;
+    setenv(line.substr(4, eq - 4).c_str(), line.substr(eq + 1).c_str(), 1);
+    return true;
+  }
+
+  if (line.compare(0, 5, "poke ") == 0) {
+    size_t space = line.find(' ', 5);
+    if (space == std::string::npos)
+      return false;
+    std::string where = line.substr(5, space - 5);
+    char* end;
+    uint64_t addr = strtoull(where.c_str(), &end, 0);
+    if (*end && !get_symbol_address(where, &addr))
+      return false;
+    uint64_t val = strtoull(line.c_str() + space + 1, &end, 0);
+    if (*end)
+      return false;
+    try {
+      procs[0]->get_mmu()->store<uint64_t>(addr, val);
+    } catch (trap_t& t) {
+      return false;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+void sim_t::serve_forks()
+{
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (fork_server_path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "--fork-server: socket path too long\n");
+    exit(1);
+  }
+  strcpy(addr.sun_path, fork_server_path.c_str());
+  unlink(addr.sun_path);
+  if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(server, 16) != 0) {
+    fprintf(stderr, "--fork-server: can't listen on %s: %s\n",
+            fork_server_path.c_str(), strerror(errno));
+    exit(1);
+  }
+  fprintf(stderr, "spike: serving forks on %s\n", fork_server_path.c_str());
+
+  // children are not waited for
+  signal(SIGCHLD, SIG_IGN);
+
+  // accept() is restarted after signals, but poll() is not, so wait in
+  // poll() to stop on ctrl-c
+  while (true) {
+    struct pollfd pfd = { server, POLLIN, 0 };
+    int conn = -1;
+    if (poll(&pfd, 1, -1) > 0)
+      conn = accept(server, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR && !ctrlc_pressed)
+        continue;
+      unlink(fork_server_path.c_str());
+      exit(errno == EINTR ? 0 : 1);
+    }
+
+    int fds[3];
+    std::vector<std::string> lines;
+    if (!read_request(conn, fds, lines)) {
+      close(conn);
+      continue;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      signal(SIGCHLD, SIG_DFL);
+      close(server);
+      for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+      }
+      for (auto& line : lines) {
+        if (!apply_fork_request(line)) {
+          fprintf(stderr, "spike: bad fork request: %s\n", line.c_str());
+          exit(1);
+        }
+      }
+      fork_client = conn;
+      return;
+    }
+
+    if (pid < 0)
+      fprintf(stderr, "spike: fork failed: %s\n", strerror(errno));
+    for (int i = 0; i < 3; i++)
+      close(fds[i]);
+    close(conn);
+  }
+}
@@ -6,4 +6,8 @@ if (STATE.v) {
 } else {
   require_privilege(get_field(STATE.mstatus->read(), MSTATUS_TVM) ? PRV_M : PRV_S);
 }
-MMU.flush_tlb();
+if (STATE.v)
+  MMU.flush_tlb_context(); // VS-stage translations are not kept across contexts
+else
+  MMU.flush_tlb_vma(insn.rs1() ? std::optional<reg_t>(RS1) : std::nullopt,
+                    insn.rs2() ? std::optional<reg_t>(RS2) : std::nullopt);
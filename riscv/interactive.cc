@@ -286,6 +286,7 @@ void sim_t::interactive()
   funcs["untiln"] = &sim_t::interactive_until_noisy;
   funcs["while"] = &sim_t::interactive_until_silent;
   funcs["dump"] = &sim_t::interactive_dumpmems;
+  funcs["checkpoint"] = &sim_t::interactive_checkpoint;
   funcs["quit"] = &sim_t::interactive_quit;
   funcs["q"] = funcs["quit"];
   funcs["help"] = &sim_t::interactive_help;
@@ -371,6 +372,7 @@ void sim_t::interactive_help(const std::string& cmd, const std::vector<std::stri
     "mem [core] <hex addr>           # Show contents of virtual memory <hex addr> in [core] (physical memory <hex addr> if omitted)\n"
     "str [core] <hex addr>           # Show NUL-terminated C string at virtual address <hex addr> in [core] (physical address <hex addr> if omitted)\n"
     "dump                            # Dump physical memory to binary files\n"
+    "checkpoint <file>               # Save the whole simulation to <file>, for --restore\n"
     "mtime                           # Show mtime\n"
     "mtimecmp <core>                 # Show mtimecmp for <core>\n"
     "until reg <core> <reg> <val>    # Stop when <reg> in <core> hits <val>\n"
@@ -781,6 +783,19 @@ void sim_t::interactive_dumpmems(const std::string& cmd, const std::vector<std::
   }
 }
 
+void sim_t::interactive_checkpoint(const std::string& cmd, const std::vector<std::string>& args)
+{
+  if (args.size() != 1)
+    throw trap_interactive();
+
+  try {
+    save_checkpoint(args[0]);
+  } catch (std::runtime_error& e) {
+    std::ostream out(sout_.rdbuf());
+    out << e.what() << std::endl;
+  }
+}
+
 void sim_t::interactive_mtime(const std::string& cmd, const std::vector<std::string>& args)
 {
   std::ostream out(sout_.rdbuf());
@@ -0,0 +1,420 @@
+// See LICENSE for license details.
+
+#include "jit.h"
+#include "processor.h"
+#include "mmu.h"
+#include "encoding.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+
+#define JIT_CODE_SIZE (4 << 20)
+// worst-case host code of one call-out, and of the prologue and epilogue
+#define JIT_MAX_INSN_CODE 160
+#define JIT_MAX_FRAME_CODE 64
+
+// Runs one instruction that has no template. Exceptions must not unwind
+// through compiled code, so they are parked in the context and the block
+// leaves with a pc that can never be a fall-through pc.
+static reg_t jit_call(jit_ctx_t* ctx, insn_func_t func, insn_bits_t bits, reg_t pc) noexcept
+{
+  try {
+    return func(ctx->proc, insn_t(bits), pc);
+  } catch (...) {
+    ctx->exception = std::current_exception();
+    return 1;
+  }
+}
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd };
+// ModRM reg field of the 0x81 (immediate) and 0xc1/0xd3 (shift) groups
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+enum { SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+// opcodes of the "op r/m, reg" forms
+enum { OP_ADD = 0x01, OP_OR = 0x09, OP_AND = 0x21, OP_SUB = 0x29, OP_XOR = 0x31, OP_CMP = 0x39 };
+
+// Register use in compiled code: r12 = context, r13 = register file,
+// r14 = &state.pc, rbx = pc of the first instruction, rax/rcx scratch.
+// The pc and instruction count of the exit are returned in rax:rdx.
+class emitter_t
+{
+public:
+  emitter_t(uint8_t* buf) : buf(buf), pos(0) {}
+  size_t size() const { return pos; }
+
+  void prologue()
+  {
+    byte(0x53);                     // push rbx
+    for (int r = R12; r <= R15; r++)
+      byte(0x41), byte(0x50 + (r & 7));
+    rr(true, 0x89, RDI, R12);
+    rr(true, 0x89, RSI, RBX);
+    mem(true, 0x8b, R13, R12, offsetof(jit_ctx_t, xpr));
+    mem(true, 0x8b, R14, R12, offsetof(jit_ctx_t, pc));
+  }
+
+  void epilogue()
+  {
+    for (size_t p : exits)
+      patch32(p, pos - (p + 4));
+    for (int r = R15; r >= R12; r--)
+      byte(0x41), byte(0x58 + (r & 7));
+    byte(0x5b);                     // pop rbx
+    byte(0xc3);
+  }
+
+  void load(int reg, unsigned x) { mem(true, 0x8b, reg, R13, 8 * x); }
+  void load32(int reg, unsigned x) { mem(false, 0x8b, reg, R13, 8 * x); }
+  void store(unsigned x) { if (x != 0) mem(true, 0x89, RAX, R13, 8 * x); }
+  void sext32() { byte(0x48); byte(0x63); byte(0xc0); }
+
+  void mov_imm(int reg, uint64_t imm)
+  {
+    rex(true, 0, reg);
+    byte(0xb8 + (reg & 7));
+    u64(imm);
+  }
+
+  // reg = pc of the first instruction + offset
+  void lea_pc(int reg, int32_t offset) { mem(true, 0x8d, reg, RBX, offset); }
+
+  void alu_imm(bool w, int ext, int32_t imm)
+  {
+    rex(w, 0, RAX);
+    byte(0x81);
+    byte(0xc0 | (ext << 3));
+    u32(imm);
+  }
+
+  // rax = rax op rcx
+  void alu(bool w, int op) { rr(w, op, RCX, RAX); }
+
+  void shift_imm(bool w, int ext, unsigned amount)
+  {
+    rex(w, 0, RAX);
+    byte(0xc1);
+    byte(0xc0 | (ext << 3));
+    byte(amount);
+  }
+
+  void shift_cl(bool w, int ext)
+  {
+    rex(w, 0, RAX);
+    byte(0xd3);
+    byte(0xc0 | (ext << 3));
+  }
+
+  // rax = flags satisfy cc ? 1 : 0
+  void setcc(int cc)
+  {
+    byte(0x0f); byte(0x90 | cc); byte(0xc0);
+    byte(0x0f); byte(0xb6); byte(0xc0);
+  }
+
+  // leave for pc + offset with count instructions run, if the flags
+  // satisfy cc (always if cc < 0)
+  void exit_to(int32_t offset, unsigned count, int cc = -1)
+  {
+    size_t skip = cc >= 0 ? jcc8(cc ^ 1) : 0;
+    lea_pc(RAX, offset);
+    exit(count);
+    if (cc >= 0)
+      buf[skip] = pos - (skip + 1);
+  }
+
+  // leave with the pc in rax if the flags satisfy cc
+  void exit_with_rax(unsigned count, int cc)
+  {
+    size_t skip = jcc8(cc ^ 1);
+    exit(count);
+    buf[skip] = pos - (skip + 1);
+  }
+
+  void call_out(insn_fetch_t fetch, int32_t offset, int32_t end, unsigned count, const size_t* size)
+  {
+    lea_pc(RCX, offset);
+    mem(true, 0x89, RCX, R14, 0);   // state.pc = pc
+    rr(true, 0x89, R12, RDI);
+    mov_imm(RSI, (uint64_t)fetch.func);
+    mov_imm(RDX, fetch.insn.bits());
+    mov_imm(RAX, (uint64_t)&jit_call);
+    byte(0xff); byte(0xd0);         // call rax
+
+    // stop as the interpreter would: no fall-through, or the block
+    // was flushed under our feet
+    lea_pc(RCX, end);
+    alu(true, OP_CMP);
+    exit_with_rax(count, CC_NE);
+    mov_imm(RCX, (uint64_t)size);
+    byte(0x48); byte(0x83); byte(0x39); byte(0x00);   // cmp qword [rcx], 0
+    exit_with_rax(count, CC_E);
+  }
+
+private:
+  uint8_t* buf;
+  size_t pos;
+  std::vector<size_t> exits;        // rel32 fields jumping to the epilogue
+
+  void byte(uint8_t b) { buf[pos++] = b; }
+  void u32(uint32_t v) { memcpy(buf + pos, &v, 4); pos += 4; }
+  void u64(uint64_t v) { memcpy(buf + pos, &v, 8); pos += 8; }
+  void patch32(size_t p, uint32_t v) { memcpy(buf + p, &v, 4); }
+
+  void rex(bool w, int reg, int rm)
+  {
+    uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (r != 0x40)
+      byte(r);
+  }
+
+  // op reg, [base + disp32]
+  void mem(bool w, uint8_t op, int reg, int base, int32_t disp)
+  {
+    rex(w, reg, base);
+    byte(op);
+    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == 4)
+      byte(0x24);
+    u32(disp);
+  }
+
+  // op rm, reg
+  void rr(bool w, uint8_t op, int reg, int rm)
+  {
+    rex(w, reg, rm);
+    byte(op);
+    byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+  }
+
+  size_t jcc8(int cc)
+  {
+    byte(0x70 | cc);
+    byte(0);
+    return pos - 1;
+  }
+
+  void exit(unsigned count)
+  {
+    byte(0xba);                     // mov edx, count
+    u32(count);
+    byte(0xe9);                     // jmp epilogue
+    exits.push_back(pos);
+    u32(0);
+  }
+};
+
+enum { CALL_OUT, INLINED, LEFT_BLOCK };
+
+// Emits the template of one instruction at offset..end of the block, or
+// returns CALL_OUT if it has none. count is the number of instructions
+// run once this one has.
+static int emit_insn(emitter_t& e, insn_t insn, int32_t offset, int32_t end, unsigned count, bool rvc)
+{
+  insn_bits_t bits = insn.bits();
+  #define IS(name) ((bits & MASK_##name) == MATCH_##name)
+
+  if (insn.length() == 2) {
+    if (!rvc)
+      return CALL_OUT;
+
+    if (IS(C_ADDI)) {
+      e.load(RAX, insn.rvc_rd()); e.alu_imm(true, ALU_ADD, insn.rvc_imm()); e.store(insn.rvc_rd());
+    } else if (IS(C_ADDIW) && insn.rvc_rd() != 0) {
+      e.load32(RAX, insn.rvc_rd()); e.alu_imm(false, ALU_ADD, insn.rvc_imm()); e.sext32(); e.store(insn.rvc_rd());
+    } else if (IS(C_LI)) {
+      e.mov_imm(RAX, insn.rvc_imm()); e.store(insn.rvc_rd());
+    } else if (IS(C_LUI) && insn.rvc_rd() == 2 && insn.rvc_addi16sp_imm() != 0) {
+      e.load(RAX, 2); e.alu_imm(true, ALU_ADD, insn.rvc_addi16sp_imm()); e.store(2);
+    } else if (IS(C_LUI) && insn.rvc_rd() != 2 && insn.rvc_imm() != 0) {
+      e.mov_imm(RAX, insn.rvc_imm() << 12); e.store(insn.rvc_rd());
+    } else if (IS(C_MV) && insn.rvc_rs2() != 0) {
+      e.load(RAX, insn.rvc_rs2()); e.store(insn.rvc_rd());
+    } else if (IS(C_ADD) && insn.rvc_rs2() != 0) {
+      e.load(RAX, insn.rvc_rs1()); e.load(RCX, insn.rvc_rs2()); e.alu(true, OP_ADD); e.store(insn.rvc_rd());
+    } else if (IS(C_SLLI)) {
+      e.load(RAX, insn.rvc_rd()); e.shift_imm(true, SHIFT_SHL, insn.rvc_zimm()); e.store(insn.rvc_rd());
+    } else if (IS(C_SRLI) || IS(C_SRAI)) {
+      e.load(RAX, insn.rvc_rs1s());
+      e.shift_imm(true, IS(C_SRLI) ? SHIFT_SHR : SHIFT_SAR, insn.rvc_zimm());
+      e.store(insn.rvc_rs1s());
+    } else if (IS(C_ANDI)) {
+      e.load(RAX, insn.rvc_rs1s()); e.alu_imm(true, ALU_AND, insn.rvc_imm()); e.store(insn.rvc_rs1s());
+    } else if (IS(C_SUB) || IS(C_XOR) || IS(C_OR) || IS(C_AND)) {
+      int op = IS(C_SUB) ? OP_SUB : IS(C_XOR) ? OP_XOR : IS(C_OR) ? OP_OR : OP_AND;
+      e.load(RAX, insn.rvc_rs1s()); e.load(RCX, insn.rvc_rs2s()); e.alu(true, op); e.store(insn.rvc_rs1s());
+    } else if (IS(C_SUBW) || IS(C_ADDW)) {
+      e.load32(RAX, insn.rvc_rs1s()); e.load32(RCX, insn.rvc_rs2s());
+      e.alu(false, IS(C_SUBW) ? OP_SUB : OP_ADD); e.sext32(); e.store(insn.rvc_rs1s());
+    } else if (IS(C_J)) {
+      e.exit_to(offset + insn.rvc_j_imm(), count);
+      return LEFT_BLOCK;
+    } else if (IS(C_BEQZ) || IS(C_BNEZ)) {
+      e.load(RAX, insn.rvc_rs1s()); e.alu_imm(true, ALU_CMP, 0);
+      e.exit_to(offset + insn.rvc_b_imm(), count, IS(C_BEQZ) ? CC_E : CC_NE);
+    } else {
+      return CALL_OUT;
+    }
+    return INLINED;
+  }
+
+  if (IS(LUI)) {
+    e.mov_imm(RAX, insn.u_imm()); e.store(insn.rd());
+  } else if (IS(AUIPC)) {
+    e.lea_pc(RAX, offset); e.alu_imm(true, ALU_ADD, insn.u_imm()); e.store(insn.rd());
+  } else if (IS(ADDI) || IS(XORI) || IS(ORI) || IS(ANDI)) {
+    int ext = IS(ADDI) ? ALU_ADD : IS(XORI) ? ALU_XOR : IS(ORI) ? ALU_OR : ALU_AND;
+    e.load(RAX, insn.rs1()); e.alu_imm(true, ext, insn.i_imm()); e.store(insn.rd());
+  } else if (IS(SLTI) || IS(SLTIU)) {
+    e.load(RAX, insn.rs1()); e.alu_imm(true, ALU_CMP, insn.i_imm());
+    e.setcc(IS(SLTI) ? CC_L : CC_B); e.store(insn.rd());
+  } else if (IS(SLLI) || IS(SRLI) || IS(SRAI)) {
+    int ext = IS(SLLI) ? SHIFT_SHL : IS(SRLI) ? SHIFT_SHR : SHIFT_SAR;
+    e.load(RAX, insn.rs1()); e.shift_imm(true, ext, insn.shamt()); e.store(insn.rd());
+  } else if (IS(ADD) || IS(SUB) || IS(XOR) || IS(OR) || IS(AND)) {
+    int op = IS(ADD) ? OP_ADD : IS(SUB) ? OP_SUB : IS(XOR) ? OP_XOR : IS(OR) ? OP_OR : OP_AND;
+    e.load(RAX, insn.rs1()); e.load(RCX, insn.rs2()); e.alu(true, op); e.store(insn.rd());
+  } else if (IS(SLT) || IS(SLTU)) {
+    e.load(RAX, insn.rs1()); e.load(RCX, insn.rs2()); e.alu(true, OP_CMP);
+    e.setcc(IS(SLT) ? CC_L : CC_B); e.store(insn.rd());
+  } else if (IS(SLL) || IS(SRL) || IS(SRA)) {
+    int ext = IS(SLL) ? SHIFT_SHL : IS(SRL) ? SHIFT_SHR : SHIFT_SAR;
+    e.load(RAX, insn.rs1()); e.load(RCX, insn.rs2()); e.shift_cl(true, ext); e.store(insn.rd());
+  } else if (IS(ADDIW)) {
+    e.load32(RAX, insn.rs1()); e.alu_imm(false, ALU_ADD, insn.i_imm()); e.sext32(); e.store(insn.rd());
+  } else if (IS(SLLIW) || IS(SRLIW) || IS(SRAIW)) {
+    int ext = IS(SLLIW) ? SHIFT_SHL : IS(SRLIW) ? SHIFT_SHR : SHIFT_SAR;
+    e.load32(RAX, insn.rs1()); e.shift_imm(false, ext, insn.shamt()); e.sext32(); e.store(insn.rd());
+  } else if (IS(ADDW) || IS(SUBW)) {
+    e.load32(RAX, insn.rs1()); e.load32(RCX, insn.rs2());
+    e.alu(false, IS(ADDW) ? OP_ADD : OP_SUB); e.sext32(); e.store(insn.rd());
+  } else if (IS(SLLW) || IS(SRLW) || IS(SRAW)) {
+    int ext = IS(SLLW) ? SHIFT_SHL : IS(SRLW) ? SHIFT_SHR : SHIFT_SAR;
+    e.load32(RAX, insn.rs1()); e.load32(RCX, insn.rs2()); e.shift_cl(false, ext); e.sext32(); e.store(insn.rd());
+  } else if (IS(JAL)) {
+    // without C, a target that is not 4-byte aligned traps in the handler
+    if (!rvc && ((offset + insn.uj_imm()) & 2))
+      return CALL_OUT;
+    e.lea_pc(RAX, end); e.store(insn.rd());
+    e.exit_to(offset + insn.uj_imm(), count);
+    return LEFT_BLOCK;
+  } else if (IS(BEQ) || IS(BNE) || IS(BLT) || IS(BGE) || IS(BLTU) || IS(BGEU)) {
+    if (!rvc && ((offset + insn.sb_imm()) & 2))
+      return CALL_OUT;
+    int cc = IS(BEQ) ? CC_E : IS(BNE) ? CC_NE : IS(BLT) ? CC_L : IS(BGE) ? CC_GE : IS(BLTU) ? CC_B : CC_AE;
+    e.load(RAX, insn.rs1()); e.load(RCX, insn.rs2()); e.alu(true, OP_CMP);
+    e.exit_to(offset + insn.sb_imm(), count, cc);
+  } else {
+    return CALL_OUT;
+  }
+  return INLINED;
+
+  #undef IS
+}
+
+bool jit_t::supported()
+{
+  return true;
+}
+
+jit_t::jit_t(processor_t* proc)
+  : proc(proc), code(NULL), code_size(0), code_used(0)
+{
+  ctx.proc = proc;
+  ctx.xpr = const_cast<reg_t*>(&proc->get_state()->XPR[0]);
+  ctx.pc = &proc->get_state()->pc;
+
+  void* p = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "jit: could not map executable memory, running interpreted\n");
+    return;
+  }
+  code = (uint8_t*)p;
+  code_size = JIT_CODE_SIZE;
+}
+
+jit_t::~jit_t()
+{
+  if (code)
+    munmap(code, code_size);
+}
+
+void jit_t::compile(block_t* block)
+{
+  // templates assume RV64 register semantics
+  if (!code || proc->get_xlen() != 64)
+    return;
+
+  if (code_size - code_used < BLOCK_INSNS * JIT_MAX_INSN_CODE + JIT_MAX_FRAME_CODE) {
+    // start over once the buffer is full, dropping every compiled block
+    proc->get_mmu()->flush_icache();
+    code_used = 0;
+    return;
+  }
+
+  bool rvc = proc->extension_enabled(EXT_ZCA);
+  emitter_t e(code + code_used);
+  size_t inlined = 0;
+  bool open = true;
+
+  e.prologue();
+  for (size_t i = 0; i < block->size && open; i++) {
+    int32_t offset = i ? block->insns[i - 1].end : 0;
+    int32_t end = block->insns[i].end;
+    switch (emit_insn(e, block->insns[i].fetch.insn, offset, end, i + 1, rvc)) {
+      case CALL_OUT:
+        e.call_out(block->insns[i].fetch, offset, end, i + 1, &block->size);
+        break;
+      case LEFT_BLOCK:
+        open = false;
+        // fall through
+      case INLINED:
+        inlined++;
+        break;
+    }
+  }
+  if (open)
+    e.exit_to(block->insns[block->size - 1].end, block->size);
+  e.epilogue();
+
+  // a block of call-outs only adds overhead
+  if (inlined == 0)
+    return;
+
+  block->jit = (jit_func_t)(code + code_used);
+  code_used = (code_used + e.size() + 15) & ~(size_t)15;
+}
+
+#else
+
+bool jit_t::supported()
+{
+  return false;
+}
+
+jit_t::jit_t(processor_t* proc)
+  : proc(proc), code(NULL), code_size(0), code_used(0)
+{
+}
+
+jit_t::~jit_t()
+{
+}
+
+void jit_t::compile(block_t* block)
+{
+}
+
+#endif
+
+void jit_t::rethrow()
+{
+  std::exception_ptr e = ctx.exception;
+  ctx.exception = nullptr;
+  std::rethrow_exception(e);
+}
@@ -0,0 +1,48 @@
+// See LICENSE for license details.
+#ifndef _RISCV_JIT_H
+#define _RISCV_JIT_H
+
+#include "decode.h"
+#include <exception>
+
+class processor_t;
+struct block_t;
+
+// What compiled blocks see of the hart
+struct jit_ctx_t {
+  processor_t* proc;
+  reg_t* xpr;                   // integer register file
+  reg_t* pc;                    // state.pc, kept current for call-outs
+  std::exception_ptr exception; // thrown by the last call-out, if any
+};
+
+// Template JIT for hot decoded blocks. Simple integer instructions are
+// emitted as host code that works on the register file directly; every
+// other instruction becomes a call to its insn_func_t. A compiled block
+// leaves exactly where the interpreter would: after an instruction that
+// does not fall through, after a call-out that stopped the block (e.g.
+// flush_icache), or when a call-out throws, so traps, interrupts and
+// instret stay exact. Only x86-64 hosts are supported.
+class jit_t
+{
+public:
+  // block entries before a block is compiled
+  static const unsigned HOT_THRESHOLD = 64;
+
+  jit_t(processor_t* proc);
+  ~jit_t();
+
+  static bool supported();
+  jit_ctx_t* context() { return &ctx; }
+  void compile(block_t* block);
+  [[noreturn]] void rethrow();
+
+private:
+  processor_t* proc;
+  jit_ctx_t ctx;
+  uint8_t* code;
+  size_t code_size;
+  size_t code_used;
+};
+
+#endif
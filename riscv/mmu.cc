@@ -19,7 +19,9 @@ mmu_t::mmu_t(simif_t* sim, endianness_t endianness, processor_t* proc)
 #ifndef RISCV_ENABLE_DUAL_ENDIAN
   assert(endianness == endianness_little);
 #endif
+  set_tlb_geometry(DEFAULT_TLB_ENTRIES, DEFAULT_TLB_WAYS);
   flush_tlb();
+  flush_icache();
   yield_load_reservation();
 }
 
@@ -29,17 +31,202 @@ mmu_t::~mmu_t()
 
 void mmu_t::flush_icache()
 {
-  for (size_t i = 0; i < ICACHE_ENTRIES; i++)
-    icache[i].tag = -1;
+  for (size_t i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+    blocks[i].paddr = -1;
+    blocks[i].size = 0;
+    blocks[i].next = NULL;
+    blocks[i].jit = NULL;
+  }
+  uncached_block.size = 0;
+  uncached_block.jit = NULL;
+}
+
+void mmu_t::flush_store_tlb()
+{
+  memset(tlb_store_tag, -1, sizeof(tlb_store_tag));
 }
 
 void mmu_t::flush_tlb()
+{
+  for (auto& e : stlb)
+    e.tag = -1;
+  stlb_spans = 0;
+
+  flush_tlb_context();
+}
+
+void mmu_t::flush_tlb_context()
 {
   memset(tlb_insn_tag, -1, sizeof(tlb_insn_tag));
   memset(tlb_load_tag, -1, sizeof(tlb_load_tag));
   memset(tlb_store_tag, -1, sizeof(tlb_store_tag));
 
-  flush_icache();
+  // Decoded blocks stay, but links between them must be re-translated,
+  // and the running block stops: its next instruction may now be elsewhere
+  fetch_epoch++;
+  if (running_block) {
+    running_block->paddr = -1;
+    running_block->size = 0;
+    running_block->next = NULL;
+    running_block->jit = NULL;
+  }
+}
+
+void mmu_t::flush_tlb_vma(std::optional<reg_t> vaddr, std::optional<reg_t> asid)
+{
+  if (!vaddr && !asid)
+    return flush_tlb();
+
+  // an ASID-specific fence leaves global mappings alone
+  if (asid)
+    asid = *asid & satp_asid(-1);
+  for (auto& e : stlb) {
+    if (e.tag == (reg_t)-1)
+      continue;
+    if (asid && ((e.pte & PTE_G) || satp_asid(e.satp) != *asid))
+      continue;
+    if (vaddr && (*vaddr >> PGSHIFT >> e.span) != e.tag)
+      continue;
+    e.tag = -1;
+  }
+
+  // the direct-mapped TLB may hold any page of an invalidated superpage
+  flush_tlb_context();
+}
+
+void mmu_t::set_tlb_geometry(size_t entries, size_t ways)
+{
+  assert(entries == 0 || (ways > 0 && entries % ways == 0));
+  stlb_ways = ways;
+  stlb_sets = entries ? entries / ways : 0;
+  assert((stlb_sets & (stlb_sets - 1)) == 0);
+  stlb.assign(entries, stlb_entry_t{reg_t(-1), 0, 0, 0, 0});
+  stlb_spans = 0;
+}
+
+reg_t mmu_t::satp_asid(reg_t satp)
+{
+  return proc->get_const_xlen() == 32 ? get_field(satp, SATP32_ASID) : get_field(satp, SATP64_ASID);
+}
+
+mmu_t::stlb_entry_t* mmu_t::stlb_lookup(reg_t vpn, reg_t satp)
+{
+  reg_t mode_mask = proc->get_const_xlen() == 32 ? SATP32_MODE : SATP64_MODE;
+  for (uint64_t spans = stlb_spans; spans; spans &= spans - 1) {
+    unsigned span = ctz(spans);
+    reg_t tag = vpn >> span;
+    stlb_entry_t* set = &stlb[(tag & (stlb_sets - 1)) * stlb_ways];
+    for (size_t i = 0; i < stlb_ways; i++) {
+      stlb_entry_t* e = &set[i];
+      if (e->tag == tag && e->span == span &&
+          (e->satp == satp || ((e->pte & PTE_G) && ((e->satp ^ satp) & mode_mask) == 0)))
+        return e;
+    }
+  }
+  return NULL;
+}
+
+void mmu_t::stlb_insert(reg_t vpn, unsigned span, reg_t satp, reg_t ppn, reg_t pte)
+{
+  reg_t tag = vpn >> span;
+  stlb_entry_t* set = &stlb[(tag & (stlb_sets - 1)) * stlb_ways];
+  stlb_entry_t* victim = &set[stlb_victim++ % stlb_ways];
+  for (size_t i = 0; i < stlb_ways; i++) {
+    if (set[i].tag == tag && set[i].span == span && set[i].satp == satp) {
+      victim = &set[i];
+      break;
+    }
+  }
+
+  *victim = {tag, satp, ppn, pte, span};
+  stlb_spans |= uint64_t(1) << span;
+}
+
+uint64_t* mmu_t::watch_page(reg_t ppn)
+{
+  std::lock_guard<std::mutex> lock(sim->page_write_lock);
+  auto it = sim->page_write_gen.find(ppn);
+  if (it != sim->page_write_gen.end())
+    return &it->second;
+
+  // drop cached store translations that would bypass the watch
+  for (auto& hart : sim->get_harts())
+    hart.second->get_mmu()->flush_store_tlb();
+  if (sim->debug_mmu)
+    sim->debug_mmu->flush_store_tlb();
+  flush_store_tlb();
+
+  return &(sim->page_write_gen[ppn] = ++sim->page_write_clock);
+}
+
+void mmu_t::page_written(reg_t paddr)
+{
+  if (sim->page_write_gen.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(sim->page_write_lock);
+  auto it = sim->page_write_gen.find(paddr >> PGSHIFT);
+  if (it != sim->page_write_gen.end()) {
+    it->second = ++sim->page_write_clock;
+    if (proc && paddr >= sim->yield_store_addr && paddr < sim->yield_store_addr + 8)
+      proc->request_yield();
+  }
+}
+
+uint64_t mmu_t::page_write_generation(reg_t vaddr)
+{
+  return *watch_page(translate(vaddr, 1, LOAD, 0) >> PGSHIFT);
+}
+
+block_t* mmu_t::refill_block(reg_t addr, block_t* block)
+{
+  icache_entry_t entry;
+  insn_fetch_t fetch = refill_icache(addr, &entry)->data;
+  reg_t pc = addr + fetch.insn.length();
+  reg_t vpn = addr >> PGSHIFT;
+
+  // only cache plain memory that is reached through the TLB, and leave
+  // traced or page-crossing instructions to a one-shot block
+  bool cacheable = entry.tag == addr && tlb_insn_tag[vpn % TLB_ENTRIES] == vpn &&
+                   ((pc - 1) >> PGSHIFT) == vpn;
+  reg_t paddr = tlb_data[vpn % TLB_ENTRIES].target_offset + addr;
+  if (cacheable && tracer.interested_in_range(paddr & PGMASK, (paddr & PGMASK) + PGSIZE, FETCH))
+    cacheable = false;
+  if (!cacheable)
+    block = &uncached_block;
+
+  block->paddr = -1;
+  block->next = NULL;
+  block->hits = 0;
+  block->jit = NULL;
+#ifdef RISCV_THREADED_DISPATCH
+  block->threaded = false;
+#endif
+  block->insns[0].fetch = fetch;
+  block->insns[0].end = pc - addr;
+  block->size = 1;
+  if (!cacheable)
+    return block;
+
+  char* host_offset = tlb_data[vpn % TLB_ENTRIES].host_offset;
+  while (block->size < BLOCK_INSNS && (pc >> PGSHIFT) == vpn) {
+    insn_bits_t insn = from_le(*(const uint16_t*)(host_offset + pc));
+    int length = insn_length(insn);
+    if (((pc + length - 1) >> PGSHIFT) != vpn)
+      break;
+    for (int i = 2; i < length; i += 2)
+      insn |= (insn_bits_t)from_le(*(const uint16_t*)(host_offset + pc + i)) << (8 * i);
+    pc += length;
+    block->insns[block->size].fetch = {proc->decode_insn(insn), insn};
+    block->insns[block->size].end = pc - addr;
+    block->size++;
+  }
+
+  // stores to the page make the block stale
+  block->gen = watch_page(paddr >> PGSHIFT);
+  block->gen_seen = *block->gen;
+  block->paddr = paddr;
+  return block;
 }
 
 void throw_access_exception(bool virt, reg_t addr, access_type type)
@@ -268,6 +455,7 @@ void mmu_t::store_slow_path_intrapage(reg_t addr, reg_t len, const uint8_t* byte
   if (actually_store) {
     if (auto host_addr = sim->addr_to_mem(paddr)) {
       memcpy(host_addr, bytes, len);
+      page_written(paddr);
       if (tracer.interested_in_range(paddr, paddr + PGSIZE, STORE))
         tracer.trace(paddr, len, STORE);
       else if (xlate_flags == 0)
@@ -300,6 +488,47 @@ void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes, uint32_
   }
 }
 
+void mmu_t::load_bytes(reg_t addr, size_t len, uint8_t* bytes)
+{
+  while (len > 0) {
+    reg_t n = std::min(reg_t(len), PGSIZE - addr % PGSIZE);
+    reg_t vpn = addr >> PGSHIFT;
+
+    if (likely(tlb_load_tag[vpn % TLB_ENTRIES] == vpn)) {
+      memcpy(bytes, tlb_data[vpn % TLB_ENTRIES].host_offset + addr, n);
+    } else {
+      check_triggers(triggers::OPERATION_LOAD, addr);
+      load_slow_path_intrapage(addr, n, bytes, 0);
+    }
+
+    if (unlikely(proc && proc->get_log_commits_enabled()))
+      proc->state.log_mem_read.push_back(std::make_tuple(addr, 0, std::min(n, reg_t(8))));
+
+    addr += n;
+    bytes += n;
+    len -= n;
+  }
+}
+
+void mmu_t::store_bytes(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  while (len > 0) {
+    reg_t n = std::min(reg_t(len), PGSIZE - addr % PGSIZE);
+    reg_t vpn = addr >> PGSHIFT;
+
+    if (likely(tlb_store_tag[vpn % TLB_ENTRIES] == vpn)) {
+      memcpy(tlb_data[vpn % TLB_ENTRIES].host_offset + addr, bytes, n);
+    } else {
+      check_triggers(triggers::OPERATION_STORE, addr);
+      store_slow_path_intrapage(addr, n, bytes, 0, true);
+    }
+
+    addr += n;
+    bytes += n;
+    len -= n;
+  }
+}
+
 tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type)
 {
   reg_t idx = (vaddr >> PGSHIFT) % TLB_ENTRIES;
@@ -322,7 +551,13 @@ tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_
       (check_triggers_store && type == STORE))
     expected_tag |= TLB_CHECK_TRIGGERS;
 
-  if (pmp_homogeneous(paddr & ~reg_t(PGSIZE - 1), PGSIZE)) {
+  bool watched = false;
+  if (type == STORE && !sim->page_write_gen.empty()) {
+    std::lock_guard<std::mutex> lock(sim->page_write_lock);
+    watched = sim->page_write_gen.count(paddr >> PGSHIFT);
+  }
+
+  if (pmp_homogeneous(paddr & ~reg_t(PGSIZE - 1), PGSIZE) && !watched) {
     if (type == FETCH) tlb_insn_tag[idx] = expected_tag;
     else if (type == STORE) tlb_store_tag[idx] = expected_tag;
     else tlb_load_tag[idx] = expected_tag;
@@ -484,7 +719,25 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
   if (masked_msbs != 0 && masked_msbs != mask)
     vm.levels = 0;
 
+  // Guest translations are never cached. A cached mapping whose
+  // permission or A/D bits do not allow this access takes the full walk,
+  // which raises the fault or updates the PTE.
+  bool cacheable = !virt && vm.levels != 0 && !stlb.empty();
+  if (cacheable) {
+    if (stlb_entry_t* e = stlb_lookup(addr >> PGSHIFT, satp)) {
+      reg_t pte = e->pte;
+      reg_t ad = PTE_A | ((type == STORE) * PTE_D);
+      bool denied = (pte & PTE_U) ? s_mode && (type == FETCH || !sum) : !s_mode;
+      denied |= type == FETCH ? !(pte & PTE_X) :
+                type == LOAD  ? !(pte & PTE_R) && !(mxr && (pte & PTE_X)) :
+                                !((pte & PTE_R) && (pte & PTE_W));
+      if (!denied && (pte & ad) == ad)
+        return (e->ppn | ((addr >> PGSHIFT) & ((reg_t(1) << e->span) - 1))) << PGSHIFT;
+    }
+  }
+
   reg_t base = vm.ptbase;
+  bool global = false;
   for (int i = vm.levels - 1; i >= 0; i--) {
     int ptshift = i * vm.idxbits;
     reg_t idx = (addr >> (PGSHIFT + ptshift)) & ((1 << vm.idxbits) - 1);
@@ -493,6 +746,7 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
     auto pte_paddr = s2xlate(addr, base + idx * vm.ptesize, LOAD, type, virt, false);
     reg_t pte = pte_load(pte_paddr, addr, virt, type, vm.ptesize);
     reg_t ppn = (pte & ~reg_t(PTE_ATTR)) >> PTE_PPN_SHIFT;
+    global |= pte & PTE_G;
     bool pbmte = virt ? (proc->get_state()->henvcfg->read() & HENVCFG_PBMTE) : (proc->get_state()->menvcfg->read() & MENVCFG_PBMTE);
     bool hade = virt ? (proc->get_state()->henvcfg->read() & HENVCFG_HADE) : (proc->get_state()->menvcfg->read() & MENVCFG_HADE);
 
@@ -542,6 +796,11 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
                         | (vpn & ((reg_t(1) << napot_bits) - 1))
                         | (vpn & ((reg_t(1) << ptshift) - 1))) << PGSHIFT;
       reg_t phys = page_base | (addr & page_mask);
+
+      if (cacheable && !(pte & PTE_PBMT)) {
+        unsigned span = std::max(ptshift, napot_bits);
+        stlb_insert(vpn, span, satp, ppn & ~((reg_t(1) << span) - 1), pte | ad | (global ? PTE_G : 0));
+      }
       return s2xlate(addr, phys, type, type, virt, hlvx) & ~page_mask;
     }
   }
@@ -557,5 +816,6 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
 void mmu_t::register_memtracer(memtracer_t* t)
 {
   flush_tlb();
+  flush_icache();
   tracer.hook(t);
 }
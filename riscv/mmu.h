@@ -33,6 +33,50 @@ struct icache_entry_t {
   insn_fetch_t data;
 };
 
+const size_t BLOCK_INSNS = 16;
+
+struct jit_ctx_t;
+// pc after the last instruction a compiled block ran, and how many it ran
+struct jit_exit_t {
+  reg_t pc;
+  reg_t count;
+};
+typedef jit_exit_t (*jit_func_t)(jit_ctx_t*, reg_t);
+
+// A run of up to BLOCK_INSNS decoded instructions within one physical page,
+// cached by the physical pc of its first instruction. Execution leaves the
+// block as soon as an instruction does not fall through to the next one.
+struct block_t {
+  reg_t paddr;            // -1 if the block holds nothing
+  size_t size;            // cleared to stop a running block
+  const uint64_t* gen;    // write generation of the page...
+  uint64_t gen_seen;      // ...when the block was decoded
+  struct block_t* next;   // successor the block was last left for
+  reg_t next_pc;
+  reg_t next_paddr;
+  uint64_t next_epoch;    // mmu fetch epoch when next was linked
+  unsigned hits;          // entries, counted while the JIT is enabled
+  jit_func_t jit;         // compiled block, if hot
+#ifdef RISCV_THREADED_DISPATCH
+  bool threaded;          // handlers below are filled in
+#endif
+  struct {
+    insn_fetch_t fetch;
+    reg_t end;            // fall-through pc, relative to the first insn
+#ifdef RISCV_THREADED_DISPATCH
+    const void* handler;  // label in execute_block_threaded
+#endif
+  } insns[BLOCK_INSNS];
+};
+
+#ifdef RISCV_THREADED_DISPATCH
+// Runs the instructions of a block like the fast loop of processor_t::step,
+// jumping from handler to handler. Stops where the loop would have stopped,
+// with pc and instret as the loop would have left them.
+void execute_block_threaded(processor_t* p, block_t* block, reg_t& pc,
+                            size_t& instret, size_t n);
+#endif
+
 struct tlb_entry_t {
   char* host_offset;
   reg_t target_offset;
@@ -76,7 +120,9 @@ public:
 
   template<typename T>
   T load_reserved(reg_t addr) {
-    return load<T>(addr, RISCV_XLATE_LR);
+    T val = load<T>(addr, RISCV_XLATE_LR);
+    load_reservation_value = val;
+    return val;
   }
 
   template<typename T>
@@ -111,6 +157,12 @@ public:
     store(addr, val, RISCV_XLATE_VIRT);
   }
 
+  // bulk accessors for accelerator extensions: move len bytes between a
+  // virtual address range and a host buffer, translating once per page.
+  // bytes are copied in target order; the caller converts with from_target.
+  void load_bytes(reg_t addr, size_t len, uint8_t* bytes);
+  void store_bytes(reg_t addr, size_t len, const uint8_t* bytes);
+
   // AMO/Zicbom faults should be reported as store faults
   #define convert_load_traps_to_store_traps(BODY) \
     try { \
@@ -131,6 +183,8 @@ public:
   T amo(reg_t addr, op f) {
     convert_load_traps_to_store_traps({
       store_slow_path(addr, sizeof(T), nullptr, 0, false, true);
+      if (unlikely(sim->parallel))
+        return amo_parallel<T>(addr, f);
       auto lhs = load<T>(addr);
       store<T>(addr, f(lhs));
       return lhs;
@@ -198,7 +252,9 @@ public:
   {
     bool have_reservation = check_load_reservation(addr, sizeof(T));
 
-    if (have_reservation)
+    if (have_reservation && unlikely(sim->parallel))
+      have_reservation = store_conditional_parallel<T>(addr, val);
+    else if (have_reservation)
       store(addr, val);
 
     yield_load_reservation();
@@ -206,11 +262,11 @@ public:
     return have_reservation;
   }
 
-  static const reg_t ICACHE_ENTRIES = 1024;
+  static const reg_t BLOCK_CACHE_ENTRIES = 2048;
 
-  inline size_t icache_index(reg_t addr)
+  inline size_t block_index(reg_t paddr)
   {
-    return (addr / PC_ALIGN) % ICACHE_ENTRIES;
+    return (paddr / PC_ALIGN) % BLOCK_CACHE_ENTRIES;
   }
 
   template<typename T>
@@ -244,7 +300,7 @@ public:
 
     insn_fetch_t fetch = {proc->decode_insn(insn), insn};
     entry->tag = addr;
-    entry->next = &icache[icache_index(addr + length)];
+    entry->next = NULL;
     entry->data = fetch;
 
     reg_t paddr = tlb_entry.target_offset + addr;;
@@ -255,12 +311,38 @@ public:
     return entry;
   }
 
-  inline icache_entry_t* access_icache(reg_t addr)
+  inline block_t* access_block(reg_t addr)
   {
-    icache_entry_t* entry = &icache[icache_index(addr)];
-    if (likely(entry->tag == addr))
-      return entry;
-    return refill_icache(addr, entry);
+    if (unlikely(check_triggers_fetch))
+      return running_block = refill_block(addr, &uncached_block);
+
+    reg_t vpn = addr >> PGSHIFT;
+    auto tlb_entry = translate_insn_addr(addr);
+    reg_t paddr = tlb_entry.target_offset + addr;
+    block_t* block = &blocks[block_index(paddr)];
+    // pages the ITLB does not hold (e.g. split by PMP) only run one-shot blocks
+    if (unlikely(block->paddr != paddr || *block->gen != block->gen_seen ||
+                 tlb_insn_tag[vpn % TLB_ENTRIES] != vpn))
+      block = refill_block(addr, block);
+    return running_block = block;
+  }
+
+  // follow the chain from prev to the block at addr
+  inline block_t* next_block(block_t* prev, reg_t addr)
+  {
+    block_t* block = prev->next;
+    if (likely(block && prev->next_pc == addr && prev->next_epoch == fetch_epoch &&
+               block->paddr == prev->next_paddr && *block->gen == block->gen_seen))
+      return running_block = block;
+
+    block = access_block(addr);
+    if (block->paddr != (reg_t)-1) {
+      prev->next = block;
+      prev->next_pc = addr;
+      prev->next_paddr = block->paddr;
+      prev->next_epoch = fetch_epoch;
+    }
+    return block;
   }
 
   inline insn_fetch_t load_insn(reg_t addr)
@@ -271,6 +353,20 @@ public:
 
   void flush_tlb();
   void flush_icache();
+  // Drop what was cached for the current privilege, mstatus and satp
+  // settings, but keep page walk results, which are tagged by satp
+  void flush_tlb_context();
+  // SFENCE.VMA: drop page walk results for one address and/or ASID
+  void flush_tlb_vma(std::optional<reg_t> vaddr, std::optional<reg_t> asid);
+  // size of the page walk TLB; 0 entries disables it
+  static const size_t DEFAULT_TLB_ENTRIES = 1024;
+  static const size_t DEFAULT_TLB_WAYS = 4;
+  void set_tlb_geometry(size_t entries, size_t ways);
+
+  // Write generation of the physical page holding vaddr. The first query
+  // starts watching the page: from then on stores to it from any hart take
+  // the slow path and move it to a new, globally unique generation.
+  uint64_t page_write_generation(reg_t vaddr);
 
   void register_memtracer(memtracer_t*);
 
@@ -304,11 +400,67 @@ private:
   processor_t* proc;
   memtracer_list_t tracer;
   reg_t load_reservation_address;
+  reg_t load_reservation_value;
+
+  // While harts run on concurrent host threads (simif_t::parallel), AMOs
+  // and SCs to memory are host compare-and-swaps, so that no store from
+  // another hart lands between their load and their store. An SC succeeds
+  // if the location still holds the value its LR read.
+  template<typename T>
+  bool host_cas(reg_t addr, reg_t paddr, T* host, T& expected, T desired)
+  {
+    T raw_e, raw_d;
+    *(target_endian<T>*)&raw_e = to_target(expected);
+    *(target_endian<T>*)&raw_d = to_target(desired);
+    if (!__atomic_compare_exchange_n(host, &raw_e, raw_d, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      expected = from_target(*(target_endian<T>*)&raw_e);
+      return false;
+    }
+
+    page_written(paddr);
+    if (unlikely(proc && proc->get_log_commits_enabled()))
+      proc->state.log_mem_write.push_back(std::make_tuple(addr, desired, sizeof(T)));
+    return true;
+  }
+
+  template<typename T, typename op>
+  T amo_parallel(reg_t addr, op f)
+  {
+    reg_t paddr = translate(addr, sizeof(T), STORE, 0);
+    T* host = (T*)sim->addr_to_mem(paddr);
+    if (!host) {
+      // MMIO accesses are serialized by the simulator
+      auto lhs = load<T>(addr);
+      store<T>(addr, f(lhs));
+      return lhs;
+    }
+
+    T lhs = load<T>(addr);
+    while (!host_cas<T>(addr, paddr, host, lhs, f(lhs)))
+      ;
+    return lhs;
+  }
+
+  template<typename T>
+  bool store_conditional_parallel(reg_t addr, T val)
+  {
+    store_slow_path(addr, sizeof(T), nullptr, 0, false, true);
+    reg_t paddr = translate(addr, sizeof(T), STORE, 0);
+    T expected = load_reservation_value;
+    return host_cas<T>(addr, paddr, (T*)sim->addr_to_mem(paddr), expected, val);
+  }
   uint16_t fetch_temp;
   reg_t blocksz;
 
-  // implement an instruction cache for simulator performance
-  icache_entry_t icache[ICACHE_ENTRIES];
+  // Cache decoded basic blocks for simulator performance. Blocks are keyed
+  // by physical address and outlive TLB flushes; links between them skip
+  // translation, so they only hold within one fetch epoch.
+  block_t blocks[BLOCK_CACHE_ENTRIES];
+  block_t uncached_block;
+  block_t* running_block = NULL;
+  uint64_t fetch_epoch = 0;
+  block_t* refill_block(reg_t addr, block_t* block);
+  void page_written(reg_t paddr);
 
   // implement a TLB for simulator performance
   static const reg_t TLB_ENTRIES = 256;
@@ -320,6 +472,31 @@ private:
   reg_t tlb_load_tag[TLB_ENTRIES];
   reg_t tlb_store_tag[TLB_ENTRIES];
 
+  // Page walk results behind the direct-mapped TLB above. Entries are
+  // set-associative and may map a superpage. They are tagged by satp, so
+  // they outlive privilege changes and address space switches; a global
+  // mapping only needs the same translation mode.
+  struct stlb_entry_t {
+    reg_t tag;        // vpn >> span, or -1 when invalid
+    reg_t satp;       // satp the mapping was walked under
+    reg_t ppn;        // first physical page of the mapping
+    reg_t pte;        // leaf PTE, with A/D as written back and G if inherited
+    unsigned span;    // log2 of the number of base pages mapped
+  };
+  std::vector<stlb_entry_t> stlb;
+  size_t stlb_sets = 0;
+  size_t stlb_ways = 0;
+  size_t stlb_victim = 0;
+  uint64_t stlb_spans = 0;   // bit n set if some entry has span n
+
+  stlb_entry_t* stlb_lookup(reg_t vpn, reg_t satp);
+  void stlb_insert(reg_t vpn, unsigned span, reg_t satp, reg_t ppn, reg_t pte);
+  reg_t satp_asid(reg_t satp);
+
+  void flush_store_tlb();
+  // start counting stores to a physical page; returns its write generation
+  uint64_t* watch_page(reg_t ppn);
+
   // finish translation on a TLB miss and update the TLB
   tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type);
   const char* fill_from_mmio(reg_t vaddr, reg_t paddr);
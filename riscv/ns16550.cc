@@ -2,6 +2,7 @@
 #include "devices.h"
 #include "processor.h"
 #include "term.h"
+#include "checkpoint.h"
 
 #define UART_QUEUE_SIZE         64
 
@@ -317,3 +318,39 @@ void ns16550_t::tick(void)
   lsr |= UART_LSR_DR;
   update_interrupt();
 }
+
+void ns16550_t::save(checkpoint_out_t& out)
+{
+  std::queue<uint8_t> rx = rx_queue;
+  out.put<uint64_t>(rx.size());
+  for (; !rx.empty(); rx.pop())
+    out.put(rx.front());
+  out.put(dll);
+  out.put(dlm);
+  out.put(iir);
+  out.put(ier);
+  out.put(fcr);
+  out.put(lcr);
+  out.put(mcr);
+  out.put(lsr);
+  out.put(msr);
+  out.put(scr);
+}
+
+void ns16550_t::restore(checkpoint_in_t& in)
+{
+  rx_queue = std::queue<uint8_t>();
+  for (uint64_t n = in.get<uint64_t>(); n > 0; n--)
+    rx_queue.push(in.get<uint8_t>());
+  in.get(dll);
+  in.get(dlm);
+  in.get(iir);
+  in.get(ier);
+  in.get(fcr);
+  in.get(lcr);
+  in.get(mcr);
+  in.get(lsr);
+  in.get(msr);
+  in.get(scr);
+  backoff_counter = 0;
+}
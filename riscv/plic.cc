@@ -2,6 +2,7 @@
 #include "devices.h"
 #include "processor.h"
 #include "simif.h"
+#include "checkpoint.h"
 
 #define PLIC_MAX_CONTEXTS 15872
 
@@ -388,3 +389,30 @@ bool plic_t::store(reg_t addr, size_t len, const uint8_t* bytes)
 
   return ret;
 }
+
+void plic_t::save(checkpoint_out_t& out)
+{
+  out.put(priority);
+  out.put(level);
+  for (auto& c : contexts) {
+    out.put(c.priority_threshold);
+    out.put(c.enable);
+    out.put(c.pending);
+    out.put(c.pending_priority);
+    out.put(c.claimed);
+  }
+}
+
+void plic_t::restore(checkpoint_in_t& in)
+{
+  in.get(priority);
+  in.get(level);
+  for (auto& c : contexts) {
+    in.get(c.priority_threshold);
+    in.get(c.enable);
+    in.get(c.pending);
+    in.get(c.pending_priority);
+    in.get(c.claimed);
+    context_update(&c);
+  }
+}
@@ -3,11 +3,14 @@
 #include "arith.h"
 #include "processor.h"
 #include "extension.h"
+#include "rocc.h"
 #include "common.h"
 #include "config.h"
 #include "decode_macros.h"
 #include "simif.h"
 #include "mmu.h"
+#include "jit.h"
+#include "profiler.h"
 #include "disasm.h"
 #include "platform.h"
 #include "vector_unit.h"
@@ -33,8 +36,9 @@ processor_t::processor_t(const isa_parser_t *isa, const cfg_t *cfg,
                          simif_t* sim, uint32_t id, bool halt_on_reset,
                          FILE* log_file, std::ostream& sout_)
   : debug(false), halt_request(HR_NONE), isa(isa), cfg(cfg), sim(sim), id(id), xlen(0),
-  histogram_enabled(false), log_commits_enabled(false),
-  log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
+  histogram_enabled(false), pc_sample_interval(0), pc_sample_countdown(0),
+  log_commits_enabled(false), log_rocc_only(false), commit_log(NULL),
+  jit(NULL), profiler(NULL), log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
   in_wfi(false), check_triggers_icount(false),
   impl_table(256, false), extension_enable_table(isa->get_extension_table()),
   last_pc(1), executions(1), TM(cfg->trigger_count)
@@ -85,6 +89,8 @@ processor_t::~processor_t()
       fprintf(stderr, "%0" PRIx64 " %" PRIu64 "\n", it.first, it.second);
   }
 
+  delete jit;
+  delete profiler;
   delete mmu;
   delete disassembler;
 }
@@ -524,6 +530,7 @@ void state_t::reset(processor_t* const proc, reg_t max_isa)
   log_reg_write.clear();
   log_mem_read.clear();
   log_mem_write.clear();
+  log_ext_write.clear();
   last_inst_priv = 0;
   last_inst_xlen = 0;
   last_inst_flen = 0;
@@ -542,11 +549,48 @@ void processor_t::set_histogram(bool value)
   histogram_enabled = value;
 }
 
+void processor_t::set_pc_sampling(size_t interval)
+{
+  pc_sample_interval = pc_sample_countdown = interval;
+}
+
 void processor_t::enable_log_commits()
 {
   log_commits_enabled = true;
 }
 
+void processor_t::enable_jit()
+{
+  if (!jit_t::supported()) {
+    fprintf(stderr, "warning: the JIT does not support this host, running interpreted\n");
+    return;
+  }
+  if (!jit)
+    jit = new jit_t(this);
+}
+
+void processor_t::enable_profiler()
+{
+  if (!profiler)
+    profiler = new profiler_t(xlen, state.pc);
+}
+
+bool processor_t::log_filtered(insn_t insn) const
+{
+  if (!log_rocc_only)
+    return false;
+
+  switch (insn.bits() & ROCC_OPCODE_MASK) {
+    case ROCC_OPCODE0:
+    case ROCC_OPCODE1:
+    case ROCC_OPCODE2:
+    case ROCC_OPCODE3:
+      return false;
+    default:
+      return true;
+  }
+}
+
 void processor_t::reset()
 {
   xlen = isa->get_max_xlen();
@@ -716,7 +760,7 @@ reg_t processor_t::legalize_privilege(reg_t prv)
 
 void processor_t::set_privilege(reg_t prv)
 {
-  mmu->flush_tlb();
+  mmu->flush_tlb_context();
   state.prv = legalize_privilege(prv);
 }
 
@@ -915,6 +959,9 @@ const char* processor_t::get_symbol(uint64_t addr)
 
 void processor_t::disasm(insn_t insn)
 {
+  if (log_filtered(insn))
+    return;
+
   uint64_t bits = insn.bits();
   if (last_pc != state.pc || last_bits != bits) {
     std::stringstream s;  // first put everything in a string, later send it to output
@@ -998,19 +1045,17 @@ insn_func_t processor_t::decode_insn(insn_t insn)
   bool rve = extension_enabled('E');
 
   if (unlikely(insn.bits() != desc.match)) {
-    // fall back to linear search
-    int cnt = 0;
-    insn_desc_t* p = &instructions[0];
-    while ((insn.bits() & p->mask) != p->match)
-      p++, cnt++;
-    desc = *p;
-
-    if (p->mask != 0 && p > &instructions[0]) {
-      if (p->match != (p - 1)->match && p->match != (p + 1)->match) {
-        // move to front of opcode list to reduce miss penalty
-        while (--p >= &instructions[0])
-          *(p + 1) = *p;
-        instructions[0] = desc;
+    // walk the decode tree down to the leaf that can hold this encoding
+    insn_bits_t bits = insn.bits();
+    const decode_node_t* node = &decode_tree[0];
+    while (node->width)
+      node = &decode_tree[node->index + ((bits >> node->shift) & ((insn_bits_t(1) << node->width) - 1))];
+
+    desc = decode_fallback;
+    for (const insn_desc_t* p = &decode_leaves[node->index]; p < &decode_leaves[node->index + node->count]; p++) {
+      if ((bits & p->mask) == p->match) {
+        desc = *p;
+        break;
       }
     }
 
@@ -1031,19 +1076,72 @@ void processor_t::register_insn(insn_desc_t desc)
 
 void processor_t::build_opcode_map()
 {
-  struct cmp {
-    bool operator()(const insn_desc_t& lhs, const insn_desc_t& rhs) {
-      if (lhs.match == rhs.match)
-        return lhs.mask > rhs.mask;
-      return lhs.match > rhs.match;
-    }
-  };
-  std::sort(instructions.begin(), instructions.end(), cmp());
+  // A catch-all descriptor matches everything, so it only applies when no
+  // other instruction does
+  decode_fallback = insn_desc_t::illegal();
+  std::vector<insn_desc_t> descs;
+  bool have_fallback = false;
+  for (auto& desc : instructions) {
+    if (desc.mask != 0)
+      descs.push_back(desc);
+    else if (!have_fallback)
+      decode_fallback = desc, have_fallback = true;
+  }
+
+  decode_tree.assign(1, decode_node_t());
+  decode_leaves.clear();
+  build_decode_node(0, descs, 0);
 
   for (size_t i = 0; i < OPCODE_CACHE_SIZE; i++)
     opcode_cache[i] = insn_desc_t::illegal();
 }
 
+void processor_t::build_decode_node(size_t node, std::vector<insn_desc_t>& descs, insn_bits_t tested)
+{
+  // Bits that every descriptor here tests and whose expected values differ
+  insn_bits_t common = ~insn_bits_t(0), ones = 0, zeros = 0;
+  for (auto& desc : descs) {
+    common &= desc.mask;
+    ones |= desc.match;
+    zeros |= ~desc.match;
+  }
+  insn_bits_t useful = common & ones & zeros & ~tested;
+
+  if (descs.size() <= DECODE_LEAF_SIZE || useful == 0) {
+    // Encodings in different leaves never overlap, so only the entries of
+    // one leaf need the usual order: more specific matches first
+    struct cmp {
+      bool operator()(const insn_desc_t& lhs, const insn_desc_t& rhs) {
+        if (lhs.match == rhs.match)
+          return lhs.mask > rhs.mask;
+        return lhs.match > rhs.match;
+      }
+    };
+    std::sort(descs.begin(), descs.end(), cmp());
+    decode_tree[node] = {0, 0, (uint32_t)decode_leaves.size(), (uint32_t)descs.size()};
+    decode_leaves.insert(decode_leaves.end(), descs.begin(), descs.end());
+    return;
+  }
+
+  // Split on a run of common bits that starts at the lowest useful one
+  unsigned shift = ctz(useful), width = 1;
+  while (width < DECODE_FIELD_WIDTH && shift + width < 64 && ((common & ~tested) >> (shift + width) & 1))
+    width++;
+  while (!((useful >> (shift + width - 1)) & 1))
+    width--;
+  insn_bits_t field_mask = (insn_bits_t(1) << width) - 1;
+
+  size_t first = decode_tree.size();
+  decode_tree.resize(first + (size_t(1) << width));
+  decode_tree[node] = {(uint8_t)shift, (uint8_t)width, (uint32_t)first, 0};
+
+  std::vector<std::vector<insn_desc_t>> children(size_t(1) << width);
+  for (auto& desc : descs)
+    children[(desc.match >> shift) & field_mask].push_back(desc);
+  for (size_t i = 0; i < children.size(); i++)
+    build_decode_node(first + i, children[i], tested | (field_mask << shift));
+}
+
 void processor_t::register_extension(extension_t* x)
 {
   for (auto insn : x->get_instructions())
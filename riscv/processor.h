@@ -22,6 +22,9 @@
 
 class processor_t;
 class mmu_t;
+class jit_t;
+class profiler_t;
+class commit_log_writer_t;
 typedef reg_t (*insn_func_t)(processor_t*, insn_t, reg_t);
 class simif_t;
 class trap_t;
@@ -71,6 +74,9 @@ typedef std::unordered_map<reg_t, freg_t> commit_log_reg_t;
 // addr, value, size
 typedef std::vector<std::tuple<reg_t, uint64_t, uint8_t>> commit_log_mem_t;
 
+// register prefix, regnum, little-endian data (extension register writes)
+typedef std::vector<std::tuple<const char*, reg_t, std::vector<uint8_t>>> commit_log_ext_t;
+
 // architectural state of a RISC-V hart
 struct state_t
 {
@@ -172,6 +178,7 @@ struct state_t
   commit_log_reg_t log_reg_write;
   commit_log_mem_t log_mem_read;
   commit_log_mem_t log_mem_write;
+  commit_log_ext_t log_ext_write;
   reg_t last_inst_priv;
   int last_inst_xlen;
   int last_inst_flen;
@@ -191,9 +198,25 @@ public:
 
   void set_debug(bool value);
   void set_histogram(bool value);
+  // record the pc every interval instructions, 0 to stop
+  void set_pc_sampling(size_t interval);
+  const std::vector<reg_t>& get_pc_samples() const { return pc_samples; }
   void enable_log_commits();
   bool get_log_commits_enabled() const { return log_commits_enabled; }
+  // log commits in binary to w rather than as text to the log file
+  void set_commit_log(commit_log_writer_t* w) { commit_log = w; }
+  commit_log_writer_t* get_commit_log() { return commit_log; }
+  void set_log_rocc_only(bool value) { log_rocc_only = value; }
+  void enable_jit();
+  // count instructions per guest function, see profiler.h
+  void enable_profiler();
+  profiler_t* get_profiler() { return profiler; }
+  // true if insn is left out of the -l and --log-commits traces
+  bool log_filtered(insn_t insn) const;
   void reset();
+  // hart state for checkpoints (see checkpoint.cc)
+  void save(checkpoint_out_t& out);
+  void restore(checkpoint_in_t& in);
   void step(size_t n); // run for n cycles
   void put_csr(int which, reg_t val);
   uint32_t get_id() const { return id; }
@@ -296,6 +319,9 @@ public:
 
   void clear_waiting_for_interrupt() { in_wfi = false; };
   bool is_waiting_for_interrupt() { return in_wfi; };
+  // end the current step() early, at the end of the running block, e.g.
+  // because the hart has just written tohost
+  void request_yield() { yield_requested = true; }
 
 private:
   const isa_parser_t * const isa;
@@ -309,11 +335,18 @@ private:
   uint32_t id;
   unsigned xlen;
   bool histogram_enabled;
+  size_t pc_sample_interval;
+  size_t pc_sample_countdown; // instructions until the next sample
   bool log_commits_enabled;
+  bool log_rocc_only;
+  commit_log_writer_t* commit_log; // owned by the sim
+  jit_t* jit; // compiles hot blocks, if enabled
+  profiler_t* profiler; // follows guest calls, if enabled
   FILE *log_file;
   std::ostream sout_; // needed for socket command interface -s, also used for -d and -l, but not for --log
   bool halt_on_reset;
   bool in_wfi;
+  bool yield_requested = false;
   bool check_triggers_icount;
   std::vector<bool> impl_table;
 
@@ -324,10 +357,28 @@ private:
 
   std::vector<insn_desc_t> instructions;
   std::unordered_map<reg_t,uint64_t> pc_histogram;
+  std::vector<reg_t> pc_samples;
 
   static const size_t OPCODE_CACHE_SIZE = 8191;
   insn_desc_t opcode_cache[OPCODE_CACHE_SIZE];
 
+  // Decision tree over the registered instructions, consulted on opcode
+  // cache misses. An inner node selects a child by a field of the
+  // instruction bits; a leaf holds the few descriptors that can still
+  // match, in priority order.
+  struct decode_node_t {
+    uint8_t shift;   // position of the field tested by an inner node
+    uint8_t width;   // field width, or 0 for a leaf
+    uint32_t index;  // first child node, or first entry in decode_leaves
+    uint32_t count;  // number of leaf entries
+  };
+  static const unsigned DECODE_LEAF_SIZE = 4;
+  static const unsigned DECODE_FIELD_WIDTH = 8;
+  std::vector<decode_node_t> decode_tree;
+  std::vector<insn_desc_t> decode_leaves;
+  insn_desc_t decode_fallback;
+
+  void step_insns(size_t n); // step() without the pc sampling
   void take_pending_interrupt() { take_interrupt(state.mip->read() & state.mie->read()); }
   void take_interrupt(reg_t mask); // take first enabled interrupt in mask
   void take_trap(trap_t& t, reg_t epc); // take an exception
@@ -347,6 +398,7 @@ private:
   void parse_varch_string(const char*);
   void parse_priv_string(const char*);
   void build_opcode_map();
+  void build_decode_node(size_t node, std::vector<insn_desc_t>& descs, insn_bits_t tested);
   void register_base_instructions();
   insn_func_t decode_insn(insn_t insn);
 
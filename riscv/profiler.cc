@@ -0,0 +1,110 @@
+// See LICENSE for license details.
+
+#include "profiler.h"
+#include <cinttypes>
+#include <map>
+
+profiler_t::profiler_t(unsigned xlen, reg_t entry)
+  : xlen(xlen)
+{
+  stack.push_back({entry, &functions[entry], 0});
+}
+
+static bool is_link(reg_t reg)
+{
+  return reg == 1 || reg == 5;
+}
+
+void profiler_t::jump(insn_t insn, reg_t npc)
+{
+  insn_bits_t bits = insn.bits();
+  reg_t rd, rs1;
+  if ((bits & 3) == 3) {
+    rd = insn.rd();
+    rs1 = (bits & 8) ? 0 : insn.rs1(); // jal has no rs1
+  } else if ((bits & 3) == 1) {
+    if (xlen != 32)
+      return; // c.addiw
+    rd = 1;
+    rs1 = 0;
+  } else {
+    rs1 = insn.rvc_rs1();
+    if (rs1 == 0)
+      return; // c.ebreak
+    rd = (bits >> 12) & 1; // c.jalr links ra, c.jr does not link
+  }
+
+  // the return address stack hints of the unprivileged ISA manual
+  if (is_link(rd)) {
+    if (is_link(rs1) && rs1 != rd)
+      ret(npc);
+    call(npc);
+  } else if (is_link(rs1)) {
+    ret(npc);
+  }
+}
+
+void profiler_t::call(reg_t entry)
+{
+  stack.back().function->calls[entry].count++;
+  stack.push_back({entry, &functions[entry], total});
+}
+
+void profiler_t::ret(reg_t npc)
+{
+  if (stack.size() == 1) {
+    // nothing to return to, as when the boot ROM jumps to the program:
+    // start over from where execution lands
+    stack[0] = {npc, &functions[npc], total};
+    return;
+  }
+
+  frame_t callee = stack.back();
+  stack.pop_back();
+  stack.back().function->calls[callee.entry].inclusive += total - callee.total;
+}
+
+void profiler_t::close_frames()
+{
+  while (stack.size() > 1)
+    ret(0);
+}
+
+void profiler_t::write_callgrind(FILE* f, const std::vector<const profiler_t*>& profilers,
+                                 std::function<std::string(reg_t)> name)
+{
+  // functions of the same name are one function, across harts too
+  struct merged_t {
+    uint64_t self = 0;
+    std::map<std::string, call_t> calls;
+  };
+  std::map<std::string, merged_t> merged;
+  uint64_t total = 0;
+  for (auto p : profilers) {
+    for (auto& fn : p->functions) {
+      merged_t& m = merged[name(fn.first)];
+      m.self += fn.second.self;
+      for (auto& c : fn.second.calls) {
+        call_t& mc = m.calls[name(c.first)];
+        mc.count += c.second.count;
+        mc.inclusive += c.second.inclusive;
+      }
+    }
+    total += p->total;
+  }
+
+  fprintf(f, "# callgrind format\n");
+  fprintf(f, "version: 1\n");
+  fprintf(f, "creator: spike\n");
+  fprintf(f, "events: Ir\n");
+  fprintf(f, "summary: %" PRIu64 "\n", total);
+  for (auto& fn : merged) {
+    fprintf(f, "\nfn=%s\n", fn.first.c_str());
+    fprintf(f, "0 %" PRIu64 "\n", fn.second.self);
+    for (auto& c : fn.second.calls) {
+      fprintf(f, "cfn=%s\n", c.first.c_str());
+      fprintf(f, "calls=%" PRIu64 " 0\n", c.second.count);
+      fprintf(f, "0 %" PRIu64 "\n", c.second.inclusive);
+    }
+  }
+}
@@ -0,0 +1,89 @@
+// See LICENSE for license details.
+#ifndef _RISCV_PROFILER_H
+#define _RISCV_PROFILER_H
+
+#include "common.h"
+#include "decode.h"
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Per-hart function profiler. A shadow call stack follows the guest's
+// calls and returns, recognized from jal/jalr and their compressed forms
+// by the link registers (ra and t0) as the ISA manual suggests for return
+// address prediction. Retired instructions are charged to the function on
+// top of the stack, which is identified by its entry pc. step_insns()
+// reports the last instruction of every block it runs, so the profiler
+// costs a call per block rather than per instruction.
+class profiler_t
+{
+public:
+  struct call_t {
+    uint64_t count = 0;
+    uint64_t inclusive = 0; // instructions retired before the callee returned
+  };
+  struct function_t {
+    uint64_t self = 0;
+    std::unordered_map<reg_t, call_t> calls; // by callee entry
+  };
+
+  profiler_t(unsigned xlen, reg_t entry);
+
+  // instret instructions have retired in this round of step_insns(), the
+  // last of them insn, after which execution continues at npc
+  void retire(size_t instret, insn_t insn, reg_t npc)
+  {
+    charge(instret);
+    if (unlikely(is_jump(insn)))
+      jump(insn, npc);
+  }
+  // the round of step_insns() ends after instret instructions
+  void end_step(size_t instret)
+  {
+    charge(instret);
+    seen = 0;
+  }
+
+  // charge the open calls as if they returned now
+  void close_frames();
+  const std::unordered_map<reg_t, function_t>& get_functions() const { return functions; }
+
+  // Writes the functions of all profilers in callgrind format, naming
+  // them with name(entry).
+  static void write_callgrind(FILE* f, const std::vector<const profiler_t*>& profilers,
+                              std::function<std::string(reg_t)> name);
+
+private:
+  struct frame_t {
+    reg_t entry;
+    function_t* function;
+    uint64_t total; // instructions retired when the frame was entered
+  };
+
+  void charge(size_t instret)
+  {
+    stack.back().function->self += instret - seen;
+    total += instret - seen;
+    seen = instret;
+  }
+  static bool is_jump(insn_t insn)
+  {
+    insn_bits_t bits = insn.bits();
+    return (bits & 0x77) == 0x67 ||            // jal, jalr
+           (bits & 0xe003) == 0x2001 ||        // c.jal on rv32
+           (bits & 0xe07f) == 0x8002;          // c.jr, c.jalr
+  }
+  void jump(insn_t insn, reg_t npc);
+  void call(reg_t entry);
+  void ret(reg_t npc);
+
+  unsigned xlen;
+  std::unordered_map<reg_t, function_t> functions;
+  std::vector<frame_t> stack;
+  uint64_t total = 0;
+  size_t seen = 0;
+};
+
+#endif
@@ -9,11 +9,13 @@
 #include "platform.h"
 #include "libfdt.h"
 #include "socketif.h"
+#include "profiler.h"
 #include <fstream>
 #include <map>
 #include <iostream>
 #include <sstream>
 #include <climits>
+#include <cinttypes>
 #include <cstdlib>
 #include <cassert>
 #include <signal.h>
@@ -211,6 +213,16 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 
 sim_t::~sim_t()
 {
+  stop_harts = true;
+  quantum_seq.fetch_add(1, std::memory_order_release);
+  for (auto& t : hart_threads)
+    t.join();
+
+  if (!pc_sample_path.empty())
+    write_pc_samples();
+  if (!profile_path.empty())
+    write_profile();
+
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
@@ -221,11 +233,27 @@ int sim_t::run()
   if (!debug && log)
     set_procs_debug(true);
 
+  if (parallel_harts && (debug || log || procs[0]->get_log_commits_enabled())) {
+    fprintf(stderr, "warning: harts run round-robin while debugging or logging\n");
+    parallel_harts = false;
+  }
+
   htif_t::set_expected_xlen(isa.get_max_xlen());
 
+  if (!fork_server_path.empty() && commit_log) {
+    fprintf(stderr, "--fork-server cannot be combined with --log-commits-bin\n");
+    exit(1);
+  }
+
   // htif_t::run() will repeatedly call back into sim_t::idle(), each
   // invocation of which will advance target time
-  return htif_t::run();
+  int exit_code = htif_t::run();
+
+  if (fork_client >= 0) {
+    dprintf(fork_client, "exit %d\n", exit_code);
+    close(fork_client);
+  }
+  return exit_code;
 }
 
 void sim_t::step(size_t n)
@@ -249,6 +277,57 @@ void sim_t::step(size_t n)
   }
 }
 
+// Quanta are a few microseconds long, shorter than it takes to wake a
+// sleeping thread, so waiting threads spin and only then yield the CPU.
+template<typename F> static void spin_until(F done)
+{
+  for (unsigned i = 0; !done(); i++) {
+    if (i < 1000) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void sim_t::hart_thread(size_t id)
+{
+  uint64_t seen = 0;
+  while (true) {
+    spin_until([&]{ return quantum_seq.load(std::memory_order_acquire) != seen; });
+    seen = quantum_seq.load(std::memory_order_acquire);
+    if (stop_harts)
+      return;
+
+    procs[id]->step(quantum_steps);
+    harts_done.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void sim_t::step_parallel(size_t n)
+{
+  if (hart_threads.empty()) {
+    for (size_t i = 1; i < procs.size(); i++)
+      hart_threads.emplace_back(&sim_t::hart_thread, this, i);
+  }
+
+  quantum_steps = n;
+  harts_done.store(0, std::memory_order_relaxed);
+  parallel = true;
+  quantum_seq.fetch_add(1, std::memory_order_release);
+
+  procs[0]->step(n);
+  spin_until([&]{ return harts_done.load(std::memory_order_acquire) == procs.size() - 1; });
+  parallel = false;
+
+  for (auto p : procs)
+    p->get_mmu()->yield_load_reservation();
+  if (clint) clint->increment(n / INSNS_PER_RTC_TICK);
+  if (ns16550) ns16550->tick();
+}
+
 void sim_t::set_debug(bool value)
 {
   debug = value;
@@ -262,24 +341,110 @@ void sim_t::set_histogram(bool value)
   }
 }
 
-void sim_t::configure_log(bool enable_log, bool enable_commitlog)
+void sim_t::set_pc_sampling(size_t interval, const char* path)
 {
-  log = enable_log;
+  pc_sample_path = path;
+  for (processor_t *proc : procs)
+    proc->set_pc_sampling(interval);
+}
+
+// One line per hart and function, "hart0;main 1234", as flamegraph.pl and
+// similar tools take it. Samples outside any symbol keep their pc.
+void sim_t::write_pc_samples()
+{
+  FILE* f = fopen(pc_sample_path.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "Unable to open pc sample file '%s'\n", pc_sample_path.c_str());
+    return;
+  }
+
+  for (processor_t *proc : procs) {
+    std::map<std::string, uint64_t> stacks;
+    for (reg_t pc : proc->get_pc_samples()) {
+      const char* symbol = htif_t::get_enclosing_symbol(pc);
+      char buf[32];
+      if (!symbol) {
+        snprintf(buf, sizeof buf, "0x%" PRIx64, pc);
+        symbol = buf;
+      }
+      stacks[symbol]++;
+    }
+    for (auto& it : stacks)
+      fprintf(f, "hart%u;%s %" PRIu64 "\n", proc->get_id(), it.first.c_str(), it.second);
+  }
+
+  fclose(f);
+}
 
-  if (!enable_commitlog)
+void sim_t::enable_profiler(const char* path)
+{
+  profile_path = path;
+  for (processor_t *proc : procs)
+    proc->enable_profiler();
+}
+
+// Functions are named by their symbol, or by the nearest symbol below
+// them and an offset. Harts are summed.
+void sim_t::write_profile()
+{
+  FILE* f = fopen(profile_path.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "Unable to open profile file '%s'\n", profile_path.c_str());
     return;
+  }
+
+  std::vector<const profiler_t*> profilers;
+  for (processor_t *proc : procs) {
+    proc->get_profiler()->close_frames();
+    profilers.push_back(proc->get_profiler());
+  }
+  profiler_t::write_callgrind(f, profilers, [this](reg_t entry) {
+    uint64_t base;
+    const char* symbol = htif_t::get_enclosing_symbol(entry, &base);
+    char buf[32];
+    if (!symbol) {
+      snprintf(buf, sizeof buf, "0x%" PRIx64, entry);
+      return std::string(buf);
+    }
+    if (base == entry)
+      return std::string(symbol);
+    snprintf(buf, sizeof buf, "+0x%" PRIx64, entry - base);
+    return symbol + std::string(buf);
+  });
+
+  fclose(f);
+}
+
+void sim_t::configure_log(bool enable_log, bool enable_commitlog, bool rocc_only)
+{
+  log = enable_log;
 
   for (processor_t *proc : procs) {
-    proc->enable_log_commits();
+    proc->set_log_rocc_only(rocc_only);
+    if (enable_commitlog)
+      proc->enable_log_commits();
   }
 }
 
+void sim_t::set_commit_log(const char* path)
+{
+  commit_log.reset(new commit_log_writer_t(path));
+  for (processor_t *proc : procs)
+    proc->set_commit_log(commit_log.get());
+}
+
 void sim_t::set_procs_debug(bool value)
 {
   for (size_t i=0; i< procs.size(); i++)
     procs[i]->set_debug(value);
 }
 
+void sim_t::enable_jit()
+{
+  for (processor_t *proc : procs)
+    proc->enable_jit();
+}
+
 static bool paddr_ok(reg_t addr)
 {
   return (addr >> MAX_PADDR_BITS) == 0;
@@ -289,6 +454,9 @@ bool sim_t::mmio_load(reg_t paddr, size_t len, uint8_t* bytes)
 {
   if (paddr + len < paddr || !paddr_ok(paddr + len - 1))
     return false;
+  std::unique_lock<std::mutex> lock(mmio_lock, std::defer_lock);
+  if (parallel)
+    lock.lock();
   return bus.load(paddr, len, bytes);
 }
 
@@ -296,6 +464,9 @@ bool sim_t::mmio_store(reg_t paddr, size_t len, const uint8_t* bytes)
 {
   if (paddr + len < paddr || !paddr_ok(paddr + len - 1))
     return false;
+  std::unique_lock<std::mutex> lock(mmio_lock, std::defer_lock);
+  if (parallel)
+    lock.lock();
   return bus.store(paddr, len, bytes);
 }
 
@@ -316,7 +487,8 @@ void sim_t::make_dtb(const char* dtb_file)
     std::pair<reg_t, reg_t> initrd_bounds = cfg->initrd_bounds();
     dts = make_dts(INSNS_PER_RTC_TICK, CPU_HZ,
                    initrd_bounds.first, initrd_bounds.second,
-                   cfg->bootargs(), cfg->pmpregions, procs, mems);
+                   cfg->bootargs(), cfg->pmpregions, procs, mems,
+                   cfg->reserved_mem);
     dtb = dts_compile(dts);
   }
 
@@ -399,6 +571,15 @@ void sim_t::reset()
 {
   if (dtb_enabled)
     set_rom();
+
+  if (!restore_path.empty()) {
+    try {
+      restore_checkpoint(restore_path);
+    } catch (std::runtime_error& e) {
+      fprintf(stderr, "Unable to restore checkpoint: %s\n", e.what());
+      exit(1);
+    }
+  }
 }
 
 void sim_t::idle()
@@ -406,17 +587,84 @@ void sim_t::idle()
   if (done())
     return;
 
-  if (debug || ctrlc_pressed)
+  if (!fork_server_path.empty() && fork_client < 0) {
+    if (reached_fork_point())
+      serve_forks();
+  } else if (debug || ctrlc_pressed) {
     interactive();
-  else
-    step(INTERLEAVE);
+  } else {
+    // Stores to tohost end the hart's quantum, and bump the generation of
+    // its page, so quanta run back to back until the target writes tohost.
+    // Every so often, and while a response waits for fromhost, HTIF gets
+    // to poll anyway: host devices such as the console make progress on
+    // their own.
+    if (!tohost_gen && get_tohost_addr()) {
+      debug_mmu->page_write_generation(get_tohost_addr());
+      tohost_gen = &page_write_gen[get_tohost_addr() >> PGSHIFT];
+      yield_store_addr = get_tohost_addr();
+    }
+    uint64_t gen = tohost_gen ? *tohost_gen : 0;
+    for (size_t quanta = 1; ; quanta++) {
+      if (parallel_harts && procs.size() > 1) {
+        step_parallel(INTERLEAVE);
+        tick_checkpoint(INTERLEAVE * procs.size());
+      } else {
+        step(INTERLEAVE);
+        tick_checkpoint(INTERLEAVE);
+      }
+
+      if (quanta == MAX_IDLE_QUANTA || !tohost_gen || *tohost_gen != gen ||
+          ctrlc_pressed || !get_fromhost_queue().empty())
+        break;
+      if (remote_bitbang)
+        remote_bitbang->tick();
+    }
+  }
 
   if (remote_bitbang)
     remote_bitbang->tick();
 }
 
+// Chunks longer than eight bytes that fall in one memory region are copied
+// straight to or from it; the rest go through the debug MMU.
+mem_t* sim_t::find_mem(addr_t taddr, size_t len, reg_t* offset)
+{
+  for (auto& m : mems) {
+    if (taddr >= m.first && taddr - m.first + len <= m.second->size()) {
+      *offset = taddr - m.first;
+      return m.second;
+    }
+  }
+  return nullptr;
+}
+
+// keep pages watched by the decoded block caches in step with memory
+void sim_t::mem_written(addr_t taddr, size_t len)
+{
+  if (page_write_gen.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(page_write_lock);
+  for (reg_t ppn = taddr >> PGSHIFT; ppn <= (taddr + len - 1) >> PGSHIFT; ppn++) {
+    auto it = page_write_gen.find(ppn);
+    if (it != page_write_gen.end())
+      it->second = ++page_write_clock;
+  }
+}
+
 void sim_t::read_chunk(addr_t taddr, size_t len, void* dst)
 {
+  reg_t offset;
+  if (len > 8) {
+    if (mem_t* mem = find_mem(taddr, len, &offset)) {
+      mem->load(offset, len, (uint8_t*)dst);
+    } else {
+      for (size_t pos = 0; pos < len; pos += 8)
+        read_chunk(taddr + pos, 8, (char*)dst + pos);
+    }
+    return;
+  }
+
   assert(len == 8);
   auto data = debug_mmu->to_target(debug_mmu->load<uint64_t>(taddr));
   memcpy(dst, &data, sizeof data);
@@ -424,12 +672,62 @@ void sim_t::read_chunk(addr_t taddr, size_t len, void* dst)
 
 void sim_t::write_chunk(addr_t taddr, size_t len, const void* src)
 {
+  reg_t offset;
+  if (len > 8) {
+    if (mem_t* mem = find_mem(taddr, len, &offset)) {
+      mem->store(offset, len, (const uint8_t*)src);
+      mem_written(taddr, len);
+    } else {
+      for (size_t pos = 0; pos < len; pos += 8)
+        write_chunk(taddr + pos, 8, (const char*)src + pos);
+    }
+    return;
+  }
+
   assert(len == 8);
   target_endian<uint64_t> data;
   memcpy(&data, src, sizeof data);
   debug_mmu->store<uint64_t>(taddr, debug_mmu->from_target(data));
 }
 
+void sim_t::clear_chunk(addr_t taddr, size_t len)
+{
+  reg_t offset;
+  if (mem_t* mem = find_mem(taddr, len, &offset)) {
+    mem->clear(offset, len);
+    mem_written(taddr, len);
+    return;
+  }
+
+  static const uint64_t zero = 0;
+  for (size_t pos = 0; pos < len; pos += 8)
+    write_chunk(taddr + pos, 8, &zero);
+}
+
+bool sim_t::host_iovecs(addr_t taddr, size_t len, bool write,
+                        std::vector<struct iovec>& iov)
+{
+  reg_t offset;
+  mem_t* mem = find_mem(taddr, len, &offset);
+  if (!mem || len == 0)
+    return false;
+
+  // pages are contiguous in a mapped region, and separate if sparse
+  for (size_t pos = 0; pos < len; ) {
+    size_t n = std::min<size_t>(PGSIZE - (offset + pos) % PGSIZE, len - pos);
+    char* host = mem->contents(offset + pos);
+    if (!iov.empty() && (char*)iov.back().iov_base + iov.back().iov_len == host)
+      iov.back().iov_len += n;
+    else
+      iov.push_back({host, n});
+    pos += n;
+  }
+
+  if (write)
+    mem_written(taddr, len);
+  return true;
+}
+
 endianness_t sim_t::get_target_endianness() const
 {
   return debug_mmu->is_target_big_endian()? endianness_big : endianness_little;
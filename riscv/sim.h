@@ -7,6 +7,7 @@
 #include "debug_module.h"
 #include "devices.h"
 #include "log_file.h"
+#include "commit_log.h"
 #include "processor.h"
 #include "simif.h"
 
@@ -15,6 +16,9 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <sys/types.h>
 
 class mmu_t;
@@ -39,14 +43,37 @@ public:
   int run();
   void set_debug(bool value);
   void set_histogram(bool value);
+  // sample the pc of every hart each interval instructions, and write the
+  // samples to path as folded stacks at exit
+  void set_pc_sampling(size_t interval, const char* path);
+  // count instructions per guest function on every hart, and write them
+  // to path in callgrind format at exit
+  void enable_profiler(const char* path);
+  // Save the harts, memory, devices and HTIF to path (see checkpoint.cc),
+  // throwing std::runtime_error on failure. A checkpoint is restored by a
+  // simulator set up the same way, once it has loaded the program.
+  void save_checkpoint(const std::string& path);
+  void set_restore_path(const char* path) { restore_path = path; }
+  // save a checkpoint to path every interval instructions
+  void set_checkpointing(size_t interval, const char* path);
+  // Once hart 0 reaches marker (a symbol or address; at once if null),
+  // serve forks of the simulation on the Unix socket at path (see
+  // fork_server.cc) instead of running on.
+  void set_fork_server(const char* path, const char* marker);
 
   // Configure logging
   //
   // If enable_log is true, an instruction trace will be generated. If
   // enable_commitlog is true, so will the commit results
-  void configure_log(bool enable_log, bool enable_commitlog);
+  void configure_log(bool enable_log, bool enable_commitlog, bool rocc_only = false);
+  // write the commit log in binary to path (see commit_log.h)
+  void set_commit_log(const char* path);
 
   void set_procs_debug(bool value);
+  // compile hot blocks to host code (see jit.h)
+  void enable_jit();
+  // run each hart on its own host thread
+  void set_parallel(bool value) { parallel_harts = value; }
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
     this->remote_bitbang = remote_bitbang;
   }
@@ -76,6 +103,7 @@ private:
   std::unique_ptr<ns16550_t> ns16550;
   bus_t bus;
   log_file_t log_file;
+  std::unique_ptr<commit_log_writer_t> commit_log;
 
   FILE *cmd_file; // pointer to debug command input file
 
@@ -86,11 +114,43 @@ private:
   void step(size_t n); // step through simulation
   static const size_t INTERLEAVE = 5000;
   static const size_t INSNS_PER_RTC_TICK = 100; // 10 MHz clock for 1 BIPS core
+  static const size_t MAX_IDLE_QUANTA = 64; // between HTIF polls (see idle())
+  uint64_t* tohost_gen = nullptr; // write generation of the tohost page
   static const size_t CPU_HZ = 1000000000; // 1GHz CPU
   size_t current_step;
   size_t current_proc;
+
+  // Parallel mode: every hart runs one quantum on its own thread (hart 0
+  // on the simulation thread), then all meet so that the devices and HTIF
+  // advance between quanta, as they do between round-robin rounds.
+  void step_parallel(size_t n);
+  void hart_thread(size_t id);
+  bool parallel_harts = false;
+  std::vector<std::thread> hart_threads;
+  std::atomic<uint64_t> quantum_seq{0};
+  std::atomic<size_t> harts_done{0};
+  size_t quantum_steps = 0;
+  bool stop_harts = false;
+  std::mutex mmio_lock;
   bool debug;
   bool histogram_enabled; // provide a histogram of PCs
+  std::string pc_sample_path; // empty unless sampling
+  void write_pc_samples();
+  std::string profile_path; // empty unless profiling
+  void write_profile();
+  std::string restore_path; // empty unless restoring
+  void restore_checkpoint(const std::string& path);
+  size_t checkpoint_interval = 0;
+  size_t checkpoint_countdown = 0;
+  std::string checkpoint_path;
+  void tick_checkpoint(size_t insns); // after insns more instructions
+  std::string fork_server_path; // empty unless serving forks
+  std::string fork_marker;
+  std::optional<reg_t> fork_pc;
+  int fork_client = -1; // in a forked child, the connection to report to
+  bool reached_fork_point();
+  bool apply_fork_request(const std::string& line);
+  void serve_forks(); // returns in each child
   bool log;
   remote_bitbang_t* remote_bitbang;
   std::optional<std::function<void()>> next_interactive_action;
@@ -124,6 +184,7 @@ private:
   void interactive_mem(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_str(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_dumpmems(const std::string& cmd, const std::vector<std::string>& args);
+  void interactive_checkpoint(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_mtime(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_mtimecmp(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_until(const std::string& cmd, const std::vector<std::string>& args, bool noisy);
@@ -142,8 +203,14 @@ private:
   virtual void idle() override;
   virtual void read_chunk(addr_t taddr, size_t len, void* dst) override;
   virtual void write_chunk(addr_t taddr, size_t len, const void* src) override;
+  virtual void clear_chunk(addr_t taddr, size_t len) override;
+  virtual bool host_iovecs(addr_t taddr, size_t len, bool write,
+                           std::vector<struct iovec>& iov) override;
   virtual size_t chunk_align() override { return 8; }
-  virtual size_t chunk_max_size() override { return 8; }
+  // ELF segments and syscall buffers are moved in chunks this large
+  virtual size_t chunk_max_size() override { return 1 << 20; }
+  mem_t* find_mem(addr_t taddr, size_t len, reg_t* offset);
+  void mem_written(addr_t taddr, size_t len);
   virtual endianness_t get_target_endianness() const override;
 
 public:
@@ -4,6 +4,8 @@
 #define _RISCV_SIMIF_H
 
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include "decode.h"
 #include "cfg.h"
 
@@ -34,6 +36,18 @@ public:
   unsigned nprocs() const { return get_cfg().nprocs(); }
 
   mmu_t* debug_mmu;  // debug port into main memory, for use by debug_module
+
+  // write generations of watched physical pages, keyed by page number
+  // (see mmu_t::page_write_generation)
+  std::unordered_map<reg_t, uint64_t> page_write_gen;
+  uint64_t page_write_clock = 0;
+  std::mutex page_write_lock;
+  // A hart that stores to these 8 bytes, on a watched page, ends its
+  // step() there (see sim_t::idle)
+  reg_t yield_store_addr = -1;
+
+  // set while harts run concurrently on their own host threads
+  bool parallel = false;
 };
 
 #endif
@@ -0,0 +1,89 @@
+// See LICENSE for license details.
+
+#include "config.h"
+
+#ifdef RISCV_THREADED_DISPATCH
+
+#include "insn_template.h"
+#include "insn_macros.h"
+#include <unordered_map>
+
+// Direct-threaded interpreter for decoded blocks. Every instruction in
+// threaded_list.h has its handler inlined here as a label, built from
+// threaded_template.cc, and each handler jumps straight to the handler of
+// the next instruction. The rest of the ISA, the rv32 and rve variants and
+// the logged variants go through insn_func_t at call_out.
+
+// Keep one indirect jump per handler: merged jumps share a single
+// prediction and the dispatch loses its point.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("no-crossjumping", "no-gcse")
+#endif
+
+#define DECODE_MACRO_USAGE_LOGGED 0
+#define xlen 64
+
+#define DEFINE_THREADED(name) \
+  reg_t fast_rv64i_##name(processor_t*, insn_t, reg_t);
+#include "threaded_list.h"
+#undef DEFINE_THREADED
+
+static const insn_func_t threaded_funcs[] = {
+#define DEFINE_THREADED(name) fast_rv64i_##name,
+#include "threaded_list.h"
+#undef DEFINE_THREADED
+};
+
+// Same exit conditions as the fast loop in processor_t::step: leave on a
+// taken branch or serialization, at the end of the block (whose size is
+// cleared when it is flushed), or one instruction short of n. pc and
+// instret live in registers; the caller's copies are stored as they change
+// so that they are current if an instruction throws.
+#define DISPATCH_NEXT(npc) \
+  do { \
+    pc = pc_out = (npc); \
+    if (unlikely(pc != start + op->end) || ++op >= block->insns + block->size) \
+      return; \
+    if (unlikely(instret + 1 == n)) \
+      return; \
+    instret_out = ++instret; \
+    STATE.pc = pc; \
+    goto *op->handler; \
+  } while (0)
+
+void execute_block_threaded(processor_t* p, block_t* block, reg_t& pc_out,
+                            size_t& instret_out, size_t n)
+{
+  static const void* const labels[] = {
+#define DEFINE_THREADED(name) &&handler_##name,
+#include "threaded_list.h"
+#undef DEFINE_THREADED
+  };
+  static const std::unordered_map<insn_func_t, const void*> handlers = [] {
+    std::unordered_map<insn_func_t, const void*> map;
+    for (size_t i = 0; i < sizeof(threaded_funcs) / sizeof(threaded_funcs[0]); i++)
+      map[threaded_funcs[i]] = labels[i];
+    return map;
+  }();
+
+  if (unlikely(!block->threaded)) {
+    for (size_t i = 0; i < block->size; i++) {
+      auto it = handlers.find(block->insns[i].fetch.func);
+      block->insns[i].handler = it == handlers.end() ? &&call_out : it->second;
+    }
+    block->threaded = true;
+  }
+
+  reg_t pc = pc_out;
+  size_t instret = instret_out;
+  const reg_t start = pc;
+  auto op = block->insns;
+  goto *op->handler;
+
+call_out:
+  DISPATCH_NEXT(op->fetch.func(p, op->fetch.insn, pc));
+
+#include "threaded_handlers.h"
+}
+
+#endif
@@ -0,0 +1,11 @@
+// See LICENSE for license details.
+
+handler_NAME:
+  {
+    insn_t insn = op->fetch.insn;
+    reg_t npc = sext_xlen(pc + insn_length(OPCODE));
+    #include "insns/NAME.h"
+    trace_opcode(p, OPCODE, insn);
+    DISPATCH_NEXT(npc);
+  }
+
@@ -0,0 +1,203 @@
+// See LICENSE for license details.
+
+// This little program turns a binary commit log written with
+// --log-commits-bin (see riscv/commit_log.h) into the text that
+// --log-commits prints, e.g.
+//   spike-commit-log run.clg.gz > run.log
+
+#include "config.h"
+#include "commit_log.h"
+#include "disasm.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static FILE* in;
+
+static void truncated()
+{
+  fprintf(stderr, "spike-commit-log: truncated record\n");
+  exit(1);
+}
+
+static uint64_t get_varint()
+{
+  uint64_t v = 0;
+  for (int shift = 0; ; shift += 7) {
+    int c = getc(in);
+    if (c == EOF)
+      truncated();
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return v;
+  }
+}
+
+static int64_t get_svarint()
+{
+  uint64_t v = get_varint();
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static std::vector<uint8_t> get_bytes(size_t len)
+{
+  std::vector<uint8_t> data(std::max<size_t>(len, sizeof(uint64_t)));
+  if (len && fread(data.data(), 1, len, in) != len)
+    truncated();
+  return data;
+}
+
+// as commit_log_print_value in riscv/execute.cc
+static void print_value(int width, const void *data)
+{
+  switch (width) {
+    case 8:
+      printf("0x%02" PRIx8, *(const uint8_t *)data);
+      break;
+    case 16:
+      printf("0x%04" PRIx16, *(const uint16_t *)data);
+      break;
+    case 32:
+      printf("0x%08" PRIx32, *(const uint32_t *)data);
+      break;
+    case 64:
+      printf("0x%016" PRIx64, *(const uint64_t *)data);
+      break;
+    default:
+      if (((width - 1) & width) == 0) {
+        const uint64_t *arr = (const uint64_t *)data;
+
+        printf("0x");
+        for (int idx = width / 64 - 1; idx >= 0; --idx) {
+          printf("%016" PRIx64, arr[idx]);
+        }
+      } else {
+        abort();
+      }
+      break;
+  }
+}
+
+static void print_value(int width, uint64_t val)
+{
+  print_value(width, &val);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1])) {
+    fprintf(stderr, "usage: spike-commit-log [<file>|-]\n");
+    return 1;
+  }
+
+  const char* path = argc == 2 ? argv[1] : "-";
+  size_t len = strlen(path);
+  bool piped = len > 3 && strcmp(path + len - 3, ".gz") == 0;
+  if (piped)
+    in = popen(("gzip -dc '" + std::string(path) + "'").c_str(), "r");
+  else
+    in = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+  if (!in) {
+    fprintf(stderr, "spike-commit-log: can't open %s\n", path);
+    return 1;
+  }
+
+  char magic[sizeof(COMMIT_LOG_MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      memcmp(magic, COMMIT_LOG_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "spike-commit-log: %s is not a binary commit log\n", path);
+    return 1;
+  }
+
+  reg_t pc = 0;
+  int c;
+  while ((c = getc(in)) != EOF) {
+    ungetc(c, in);
+    unsigned core = get_varint();
+    int priv = get_varint();
+    int xlen = get_varint();
+    int flen = get_varint();
+    pc += get_svarint();
+    insn_t insn(get_varint());
+
+    printf("core%4" PRId32 ": ", core);
+    printf("%1d ", priv);
+    print_value(xlen, pc);
+    printf(" (");
+    print_value(insn.length() * 8, insn.bits());
+    printf(")");
+
+    uint64_t writes = get_varint();
+    uint64_t vsew = 0, vl = 0, vlen = 0;
+    int64_t lmul = 0;
+    if (writes & 1) {
+      vsew = get_varint();
+      lmul = get_svarint();
+      vl = get_varint();
+      vlen = get_varint();
+    }
+    bool show_vec = false;
+    for (writes >>= 1; writes > 0; writes--) {
+      uint64_t key = get_varint();
+      int rd = key >> 4;
+      switch (key & 0xf) {
+        case 0:
+          printf(" x%-2d ", rd);
+          print_value(xlen, get_bytes(xlen / 8).data());
+          break;
+        case 1:
+          printf(" f%-2d ", rd);
+          print_value(flen, get_bytes(flen / 8).data());
+          break;
+        case 4:
+          printf(" c%d_%s ", rd, csr_name(rd));
+          print_value(xlen, get_bytes(xlen / 8).data());
+          break;
+      }
+      if ((key & 0xf) == 2 || (key & 0xf) == 3) {
+        if (!show_vec) {
+          printf(" e%ld %s%ld l%ld", (long)vsew, lmul < 0 ? "mf" : "m",
+                 (long)(lmul < 0 ? -lmul : lmul), (long)vl);
+          show_vec = true;
+        }
+        if ((key & 0xf) == 2) {
+          printf(" v%-2d ", rd);
+          print_value(vlen, get_bytes(vlen / 8).data());
+        }
+      }
+    }
+
+    for (uint64_t n = get_varint(); n > 0; n--) {
+      size_t name_len = get_varint();
+      std::string name((const char*)get_bytes(name_len).data(), name_len);
+      int index = get_varint();
+      size_t size = get_varint();
+      std::vector<uint8_t> data = get_bytes(size);
+      printf(" %s%-2d 0x", name.c_str(), index);
+      for (size_t i = size; i > 0; i--)
+        printf("%02" PRIx8, data[i - 1]);
+    }
+
+    for (uint64_t n = get_varint(); n > 0; n--) {
+      printf(" mem ");
+      print_value(xlen, get_varint());
+    }
+
+    for (uint64_t n = get_varint(); n > 0; n--) {
+      reg_t addr = get_varint();
+      size_t size = get_varint();
+      printf(" mem ");
+      print_value(xlen, addr);
+      printf(" ");
+      print_value(size * 8, get_bytes(size).data());
+    }
+    putchar('\n');
+  }
+
+  if (piped)
+    pclose(in);
+  return 0;
+}
@@ -0,0 +1,82 @@
+// See LICENSE for license details.
+
+// This little program runs the program of a spike started with
+// --fork-server (see riscv/fork_server.cc) from where that spike stopped,
+// with this program's stdin, stdout and stderr, and exits as it does, e.g.
+//   spike-fork /tmp/spike.sock --env=SEED=42 --poke=iterations=100
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void usage()
+{
+  fprintf(stderr, "usage: spike-fork <socket> [--env=<name>=<value>]... "
+                  "[--poke=<symbol|addr>=<value>]...\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || argv[1][0] == '-')
+    usage();
+
+  std::string request;
+  for (int i = 2; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* eq;
+    if (strncmp(arg, "--env=", 6) == 0 && strchr(arg + 6, '=')) {
+      request += "env " + std::string(arg + 6) + "\n";
+    } else if (strncmp(arg, "--poke=", 7) == 0 && (eq = strchr(arg + 7, '='))) {
+      request += "poke " + std::string(arg + 7, eq) + " " + (eq + 1) + "\n";
+    } else {
+      usage();
+    }
+  }
+  request += "run\n";
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (conn < 0 || connect(conn, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "spike-fork: can't connect to %s\n", argv[1]);
+    return 1;
+  }
+
+  // pass our stdio along with the request
+  int fds[3] = { 0, 1, 2 };
+  char control[CMSG_SPACE(sizeof(fds))] = {};
+  struct iovec iov = { &request[0], request.size() };
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(c), fds, sizeof(fds));
+  if (sendmsg(conn, &msg, 0) != (ssize_t)request.size()) {
+    fprintf(stderr, "spike-fork: can't send the request to %s\n", argv[1]);
+    return 1;
+  }
+
+  std::string reply;
+  char buf[64];
+  ssize_t n;
+  while ((n = read(conn, buf, sizeof(buf))) > 0)
+    reply.append(buf, n);
+
+  int code;
+  if (sscanf(reply.c_str(), "exit %d", &code) != 1) {
+    fprintf(stderr, "spike-fork: the simulation died\n");
+    return 1;
+  }
+  return code;
+}
@@ -18,6 +18,11 @@
 #include <fstream>
 #include <limits>
 #include <cinttypes>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../VERSION"
 
 static void help(int exit_code = 1)
@@ -58,6 +63,28 @@ static void help(int exit_code = 1)
   fprintf(stderr, "                          The extlib flag for the library must come first.\n");
   fprintf(stderr, "  --log-cache-miss      Generate a log of cache miss\n");
   fprintf(stderr, "  --log-commits         Generate a log of commits info\n");
+  fprintf(stderr, "  --log-commits-bin=<file>\n");
+  fprintf(stderr, "                          Write the commit log in binary to <file> (gzipped if\n");
+  fprintf(stderr, "                          it ends in .gz); read it with spike-commit-log\n");
+  fprintf(stderr, "  --log-rocc-only       Only log RoCC (e.g. FIONA) instructions with -l and --log-commits\n");
+  fprintf(stderr, "  --jit                 Compile frequently executed code to host code\n");
+  fprintf(stderr, "  --parallel            Run each hart on its own host thread\n");
+  fprintf(stderr, "  --huge-pages          Back guest memory with huge pages if the host allows\n");
+  fprintf(stderr, "  --pc-sample=<n>[:<file>]\n");
+  fprintf(stderr, "                        Sample the PC every n instructions and write folded stacks\n");
+  fprintf(stderr, "                          to <file> at exit [default spike.folded]\n");
+  fprintf(stderr, "  --profile=<file>      Count instructions per guest function and write them\n");
+  fprintf(stderr, "                          to <file> in callgrind format at exit\n");
+  fprintf(stderr, "  --checkpoint=<n>:<file>\n");
+  fprintf(stderr, "                        Save a checkpoint of the simulation to <file> every n\n");
+  fprintf(stderr, "                          instructions\n");
+  fprintf(stderr, "  --restore=<file>      Resume from the checkpoint in <file>; the other options\n");
+  fprintf(stderr, "                          and the program must be those it was saved with\n");
+  fprintf(stderr, "  --fork-server=<socket>\n");
+  fprintf(stderr, "                        Stop at --fork-at and fork a run of the rest of the program\n");
+  fprintf(stderr, "                          for each spike-fork client connecting to <socket>\n");
+  fprintf(stderr, "  --fork-at=<symbol|addr>\n");
+  fprintf(stderr, "                        Where hart 0 stops for --fork-server [default: at the entry]\n");
   fprintf(stderr, "  --extension=<name>    Specify RoCC Extension\n");
   fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "  --extlib=<name>       Shared library to load\n");
@@ -68,6 +95,9 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --disable-dtb         Don't write the device tree blob into memory\n");
   fprintf(stderr, "  --kernel=<path>       Load kernel flat image into memory\n");
   fprintf(stderr, "  --initrd=<path>       Load kernel initrd into memory\n");
+  fprintf(stderr, "  --blob=<path>@<addr>  Map a file copy-on-write into memory at <addr>, and mark\n");
+  fprintf(stderr, "                          it reserved in the device tree\n");
+  fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "  --bootargs=<args>     Provide custom bootargs for kernel [default: %s]\n",
           DEFAULT_KERNEL_BOOTARGS);
   fprintf(stderr, "  --real-time-clint     Increment clint time at real-time rate\n");
@@ -86,6 +116,8 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --dm-no-halt-groups   Debug module won't support halt groups\n");
   fprintf(stderr, "  --dm-no-impebreak     Debug module won't support implicit ebreak in program buffer\n");
   fprintf(stderr, "  --blocksz=<size>      Cache block size (B) for CMO operations(powers of 2) [default 64]\n");
+  fprintf(stderr, "  --tlb=<n>[:<w>]       Page walk TLB with n entries in w ways, 0 to disable [default %zu:%zu]\n",
+          mmu_t::DEFAULT_TLB_ENTRIES, mmu_t::DEFAULT_TLB_WAYS);
 
   exit(exit_code);
 }
@@ -265,16 +297,75 @@ static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
   return merged_mem;
 }
 
-static std::vector<std::pair<reg_t, mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout)
+static std::vector<std::pair<reg_t, mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout,
+                                                        bool huge_pages)
 {
   std::vector<std::pair<reg_t, mem_t*>> mems;
   mems.reserve(layout.size());
   for (const auto &cfg : layout) {
-    mems.push_back(std::make_pair(cfg.get_base(), new mem_t(cfg.get_size())));
+    mems.push_back(std::make_pair(cfg.get_base(), new mem_t(cfg.get_size(), huge_pages)));
   }
   return mems;
 }
 
+// A blob goes into the memory region around it, or else into a region of
+// its own. The file is mapped rather than read, so that only the pages the
+// program touches are read in, and writes never reach the file.
+static void add_blob_regions(const std::vector<std::pair<std::string, reg_t>>& blobs,
+                             std::vector<mem_cfg_t>& layout, cfg_t& cfg)
+{
+  for (auto& blob : blobs) {
+    struct stat st;
+    if (stat(blob.first.c_str(), &st) != 0 || st.st_size == 0) {
+      fprintf(stderr, "--blob: can't map %s\n", blob.first.c_str());
+      exit(1);
+    }
+    reg_t size = (st.st_size + PGSIZE - 1) & ~(PGSIZE - 1);
+    if (!mem_cfg_t::check_if_supported(blob.second, size)) {
+      fprintf(stderr, "--blob: %s must start on a page boundary\n", blob.first.c_str());
+      exit(1);
+    }
+    mem_cfg_t region(blob.second, size);
+
+    bool inside = false;
+    for (auto& m : layout) {
+      if (region.get_base() >= m.get_base() &&
+          region.get_inclusive_end() <= m.get_inclusive_end()) {
+        inside = true;
+      } else if (region.get_base() <= m.get_inclusive_end() &&
+                 m.get_base() <= region.get_inclusive_end()) {
+        fprintf(stderr, "--blob: %s straddles the memory region at 0x%" PRIx64 "\n",
+                blob.first.c_str(), m.get_base());
+        exit(1);
+      }
+    }
+    if (!inside)
+      layout.push_back(region);
+    cfg.reserved_mem.push_back(region);
+  }
+}
+
+static void map_blobs(const std::vector<std::pair<std::string, reg_t>>& blobs,
+                      const std::vector<std::pair<reg_t, mem_t*>>& mems)
+{
+  for (auto& blob : blobs) {
+    int fd = open(blob.first.c_str(), O_RDONLY);
+    struct stat st;
+    bool ok = fd >= 0 && fstat(fd, &st) == 0;
+    for (auto& m : mems) {
+      if (ok && blob.second >= m.first && blob.second - m.first < m.second->size()) {
+        ok = m.second->map_file(blob.second - m.first, st.st_size, fd, 0);
+        break;
+      }
+    }
+    if (!ok) {
+      fprintf(stderr, "--blob: can't map %s: %s\n", blob.first.c_str(), strerror(errno));
+      exit(1);
+    }
+    close(fd);
+  }
+}
+
 static unsigned long atoul_safe(const char* s)
 {
   char* e;
@@ -342,14 +433,30 @@ int main(int argc, char** argv)
   std::unique_ptr<cache_sim_t> l2;
   bool log_cache = false;
   bool log_commits = false;
+  const char* commit_log_path = NULL;
+  bool log_rocc_only = false;
+  bool jit = false;
+  bool parallel = false;
+  bool huge_pages = false;
   const char *log_path = nullptr;
   std::vector<std::function<extension_t*()>> extensions;
   const char* initrd = NULL;
+  std::vector<std::pair<std::string, reg_t>> blobs;
   const char* dtb_file = NULL;
   uint16_t rbb_port = 0;
   bool use_rbb = false;
   unsigned dmi_rti = 0;
   reg_t blocksz = 64;
+  size_t tlb_entries = mmu_t::DEFAULT_TLB_ENTRIES;
+  size_t tlb_ways = mmu_t::DEFAULT_TLB_WAYS;
+  size_t pc_sample_interval = 0;
+  const char* pc_sample_path = "spike.folded";
+  const char* profile_path = NULL;
+  size_t checkpoint_interval = 0;
+  const char* checkpoint_path = NULL;
+  const char* fork_server_path = NULL;
+  const char* fork_marker = NULL;
+  const char* restore_path = NULL;
   debug_module_config_t dm_config = {
     .progbufsize = 2,
     .max_sba_data_width = 0,
@@ -455,6 +562,16 @@ int main(int argc, char** argv)
   parser.option(0, "dtb", 1, [&](const char *s){dtb_file = s;});
   parser.option(0, "kernel", 1, [&](const char* s){kernel = s;});
   parser.option(0, "initrd", 1, [&](const char* s){initrd = s;});
+  parser.option(0, "blob", 1, [&](const char* s){
+    const char* at = strrchr(s, '@');
+    char* p;
+    reg_t addr = at ? strtoull(at + 1, &p, 0) : 0;
+    if (!at || at == s || !at[1] || *p) {
+      fprintf(stderr, "--blob must give a file and an address, as in --blob=<path>@<addr>\n");
+      exit(-1);
+    }
+    blobs.push_back(std::make_pair(std::string(s, at), addr));
+  });
   parser.option(0, "bootargs", 1, [&](const char* s){cfg.bootargs = s;});
   parser.option(0, "real-time-clint", 0, [&](const char UNUSED *s){cfg.real_time_clint = true;});
   parser.option(0, "triggers", 1, [&](const char *s){cfg.trigger_count = atoul_safe(s);});
@@ -487,6 +604,13 @@ int main(int argc, char** argv)
       [&](const char UNUSED *s){dm_config.support_haltgroups = false;});
   parser.option(0, "log-commits", 0,
                 [&](const char UNUSED *s){log_commits = true;});
+  parser.option(0, "log-commits-bin", 1,
+                [&](const char* s){log_commits = true; commit_log_path = s;});
+  parser.option(0, "log-rocc-only", 0,
+                [&](const char UNUSED *s){log_rocc_only = true;});
+  parser.option(0, "jit", 0, [&](const char UNUSED *s){jit = true;});
+  parser.option(0, "parallel", 0, [&](const char UNUSED *s){parallel = true;});
+  parser.option(0, "huge-pages", 0, [&](const char UNUSED *s){huge_pages = true;});
   parser.option(0, "log", 1,
                 [&](const char* s){log_path = s;});
   FILE *cmd_file = NULL;
@@ -507,13 +631,52 @@ int main(int argc, char** argv)
     }
   });
 
+  parser.option(0, "tlb", 1, [&](const char* s){
+    char* p;
+    tlb_entries = strtoull(s, &p, 0);
+    if (*p == ':')
+      tlb_ways = strtoull(p + 1, &p, 0);
+    size_t sets = tlb_ways ? tlb_entries / tlb_ways : 0;
+    if (*p || (tlb_entries && (!tlb_ways || tlb_entries % tlb_ways || (sets & (sets - 1))))) {
+      fprintf(stderr, "--tlb must give a number of entries that is a power-of-2 multiple of the ways\n");
+      exit(-1);
+    }
+  });
+
+  parser.option(0, "profile", 1, [&](const char* s){profile_path = s;});
+  parser.option(0, "pc-sample", 1, [&](const char* s){
+    char* p;
+    pc_sample_interval = strtoull(s, &p, 0);
+    if (*p == ':' && p[1])
+      pc_sample_path = p + 1;
+    else if (*p || pc_sample_interval == 0) {
+      fprintf(stderr, "--pc-sample must give a nonzero number of instructions\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "checkpoint", 1, [&](const char* s){
+    char* p;
+    checkpoint_interval = strtoull(s, &p, 0);
+    if (*p != ':' || !p[1] || checkpoint_interval == 0) {
+      fprintf(stderr, "--checkpoint must give a nonzero number of instructions and a file\n");
+      exit(-1);
+    }
+    checkpoint_path = p + 1;
+  });
+  parser.option(0, "restore", 1, [&](const char* s){restore_path = s;});
+  parser.option(0, "fork-server", 1, [&](const char* s){fork_server_path = s;});
+  parser.option(0, "fork-at", 1, [&](const char* s){fork_marker = s;});
+
   auto argv1 = parser.parse(argv);
   std::vector<std::string> htif_args(argv1, (const char*const*)argv + argc);
 
   if (!*argv1)
     help();
 
-  std::vector<std::pair<reg_t, mem_t*>> mems = make_mems(cfg.mem_layout());
+  std::vector<mem_cfg_t> layout = cfg.mem_layout();
+  add_blob_regions(blobs, layout, cfg);
+  std::vector<std::pair<reg_t, mem_t*>> mems = make_mems(layout, huge_pages);
+  map_blobs(blobs, mems);
 
   if (kernel && check_file_exists(kernel)) {
     const char *isa = cfg.isa();
@@ -591,11 +754,27 @@ int main(int argc, char** argv)
     for (auto e : extensions)
       s.get_core(i)->register_extension(e());
     s.get_core(i)->get_mmu()->set_cache_blocksz(blocksz);
+    s.get_core(i)->get_mmu()->set_tlb_geometry(tlb_entries, tlb_ways);
   }
 
   s.set_debug(debug);
-  s.configure_log(log, log_commits);
+  s.configure_log(log, log_commits, log_rocc_only);
+  if (commit_log_path)
+    s.set_commit_log(commit_log_path);
   s.set_histogram(histogram);
+  if (pc_sample_interval)
+    s.set_pc_sampling(pc_sample_interval, pc_sample_path);
+  if (profile_path)
+    s.enable_profiler(profile_path);
+  if (checkpoint_path)
+    s.set_checkpointing(checkpoint_interval, checkpoint_path);
+  if (restore_path)
+    s.set_restore_path(restore_path);
+  if (fork_server_path)
+    s.set_fork_server(fork_server_path, fork_marker);
+  if (jit)
+    s.enable_jit();
+  s.set_parallel(parallel);
 
   auto return_code = s.run();
 